@@ -5,6 +5,7 @@
 #include <typeinfo>
 
 #include <cstring>
+#include <algorithm>
 
 #if defined(LOCAL_LIBVGM)
 #include "audio/AudioStream.h"
@@ -14,16 +15,21 @@
 #include <vgm/audio/AudioStream_SpcDrvFuns.h>
 #endif
 
+// Samples mixed per pass in the audio callback
+const unsigned int Audio_Manager::mix_buffer_size = 4096;
+// Streams that can play at the same time
+const unsigned int Audio_Manager::max_streams = 16;
+
 //! First time initialization
 Audio_Manager::Audio_Manager()
 	: driver_sig(-1)
 	, driver_id(-1)
 	, device_id(-1)
 	, sample_rate(44100)
-	, sample_size(4)
+	, converter(Sample_Converter::S16, 2)
 	, volume(1.0)
-	, converted_volume(0x100)
-	, streams()
+	, volume_pending(false)
+	, mixer(mix_buffer_size, max_streams)
 	, window_handle(nullptr)
 	, driver_handle(nullptr)
 	, waiting_for_handle(false)
@@ -199,11 +205,41 @@ int Audio_Manager::set_sample_rate(uint32_t new_sample_rate)
 	return 0;
 }
 
+//! Set the output sample format and channel count.
+/*!
+ *  This must be called before the audio device is opened.
+ *
+ *  libvgm audio drivers only support integer samples, so F32 is not
+ *  supported here. It can still be used for offline rendering.
+ *
+ *  \return zero if successful, non-zero otherwise.
+ */
+int Audio_Manager::set_output_format(Sample_Converter::Format new_format, unsigned int new_channels)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(device_opened || new_format == Sample_Converter::F32 || !new_channels)
+		return -1;
+	converter = Sample_Converter(new_format, new_channels);
+	return 0;
+}
+
 //! Set global volume
+/*!
+ *  The change is passed to the audio thread and ramped in by the mixer.
+ */
 void Audio_Manager::set_volume(float new_volume)
 {
-	volume = volume;
-	converted_volume = volume * 256.0;
+	std::lock_guard<std::mutex> lock(mutex);
+	volume = new_volume;
+	volume_pending = true;
+	update_volume();
+}
+
+//! Send the volume to the mixer. The mutex must be held.
+void Audio_Manager::update_volume()
+{
+	if(volume_pending && mixer.set_volume(volume * Audio_Mixer::unity_gain))
+		volume_pending = false;
 }
 
 //! Get global volume
@@ -213,19 +249,41 @@ float Audio_Manager::get_volume() const
 }
 
 //! Add an audio stream
+/*!
+ *  \return zero if successful, non-zero if too many streams are playing.
+ */
 int Audio_Manager::add_stream(std::shared_ptr<Audio_Stream> stream)
 {
 	std::lock_guard<std::mutex> lock(mutex);
+	mixer.collect();
 	stream->setup_stream(sample_rate);
 	printf("Adding stream %s\n", typeid(*stream).name());
-	streams.push_back(stream);
+	if(!mixer.add_stream(stream))
+	{
+		fprintf(stderr, "Warning: too many audio streams\n");
+		return -1;
+	}
 	return 0;
 }
 
+//! Stop and release finished audio streams.
+/*!
+ *  Finished streams are not released on the audio thread. Call this
+ *  regularly from the main loop. Volume changes that did not fit in the
+ *  mixer queue are also retried here.
+ */
+void Audio_Manager::collect_streams()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	mixer.collect();
+	update_volume();
+}
+
 //! Kill all streams and close audio system
 void Audio_Manager::clean_up()
 {
 	close_driver();
+	collect_streams();
 	if(audio_initialized)
 		Audio_Deinit();
 }
@@ -347,9 +405,8 @@ int Audio_Manager::open_device()
 		return -1;
 	const std::lock_guard<std::mutex> lock(mutex);
 	auto opts = AudioDrv_GetOptions(driver_handle);
-	opts->numChannels = 2;
-	opts->numBitsPerSmpl = 16;
-	sample_size = opts->numChannels * opts->numBitsPerSmpl / 8;
+	opts->numChannels = converter.get_channels();
+	opts->numBitsPerSmpl = Sample_Converter::get_sample_size(converter.get_format()) * 8;
 	AudioDrv_SetCallback(driver_handle, Audio_Manager::callback, NULL);
 	int error_code = AudioDrv_Start(driver_handle, device_id);
 	if(error_code)
@@ -368,58 +425,24 @@ void Audio_Manager::close_device()
 	device_opened = false;
 }
 
-inline int16_t Audio_Manager::clip16(int32_t input)
-{
-	if(input > 32767)
-		input = 32767;
-	else if(input < -32768)
-		input = -32768;
-	return input;
-}
-
+//! Audio driver callback.
+/*!
+ *  This runs on the audio thread. It must not lock, allocate or print.
+ */
 uint32_t Audio_Manager::callback(void* drv_struct, void* user_param, uint32_t buf_size, void* data)
 {
 	Audio_Manager& am = Audio_Manager::get();
-	int sample_count = buf_size / am.sample_size;
-	std::vector<WAVE_32BS> buffer(sample_count, {0, 0});
-	const std::lock_guard<std::mutex> lock(am.mutex);
-
-	// Input buffer
-	for(auto stream = am.streams.begin(); stream != am.streams.end();)
-	{
-		Audio_Stream* s = stream->get();
-		s->get_sample(buffer.data(), sample_count, 2);
-		if(s->get_finished())
-		{
-			printf("Removing stream %s\n", typeid(*s).name());
-			s->stop_stream();
-			am.streams.erase(stream);
-		}
-		else
-		{
-			stream++;
-		}
-	}
+	uint32_t frame_size = am.converter.get_frame_size();
+	uint32_t sample_count = buf_size / frame_size;
+	uint8_t* output = (uint8_t*) data;
 
-	// Output buffer
-	switch(am.sample_size)
+	uint32_t position = 0;
+	while(position < sample_count)
 	{
-		case 4:
-		{
-			int16_t* sd = (int16_t*) data;
-			for(int i = 0; i < sample_count; i ++)
-			{
-				int32_t l = buffer[i].L >> 8;
-				int32_t r = buffer[i].R >> 8;
-				*sd++ = clip16((l * am.converted_volume) >> 8);
-				*sd++ = clip16((r * am.converted_volume) >> 8);
-			}
-			return sample_count * am.sample_size;
-		}
-		default:
-		{
-			return 0;
-		}
+		uint32_t count = std::min(sample_count - position, am.mixer.get_max_samples());
+		const WAVE_32BS* buffer = am.mixer.mix(count);
+		am.converter.convert(buffer, output + position * frame_size, count);
+		position += count;
 	}
+	return sample_count * frame_size;
 }
-
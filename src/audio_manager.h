@@ -15,59 +15,9 @@
 #include <vgm/emu/Resampler.h>
 #endif
 
-//! Abstract class for audio stream control
-class Audio_Stream
-{
-	public:
-		inline Audio_Stream()
-			: finished(false)
-		{}
-
-		inline virtual ~Audio_Stream()
-		{}
-
-		//! called by Audio_Manager when starting the stream.
-		/*!
-		 *  setup your resamplers and stuff here.
-		 */
-		virtual void setup_stream(uint32_t sample_rate) = 0;
-
-		//! called by Audio_Manager during stream update.
-		/*!
-		 *  return zero to indicate that the stream should be stopped.
-		 */
-		virtual int get_sample(WAVE_32BS* output, int count, int channels) = 0;
-
-		//! called by Audio_Manager when stopping the stream.
-		/*!
-		 *  resamplers should be cleaned up, but the playback may start again
-		 *  so the "finished" state should not be updated here.
-		 */
-		virtual void stop_stream() = 0;
-
-		//! get the "finished" flag status
-		/*!
-		 *  when set, the audio manager will stop mixing this stream and
-		 *  destroy its pointer.
-		 */
-		inline void set_finished(bool flag)
-		{
-			finished = true;
-		}
-
-		//! get the "finished" flag status
-		/*!
-		 *  when set, the audio manager will stop mixing this stream and
-		 *  destroy its pointer.
-		 */
-		inline bool get_finished()
-		{
-			return finished;
-		}
-
-	protected:
-		bool finished;
-};
+#include "audio_stream.h"
+#include "audio_mixer.h"
+#include "sample_converter.h"
 
 //! Audio manager class
 /*!
@@ -88,6 +38,7 @@ class Audio_Manager
 		void set_window_handle(void* new_handle);
 
 		int set_sample_rate(uint32_t new_sample_rate);
+		int set_output_format(Sample_Converter::Format new_format, unsigned int new_channels);
 		void set_volume(float new_volume);
 		float get_volume() const;
 
@@ -98,6 +49,7 @@ class Audio_Manager
 		inline int get_device() const { return device_id; };
 
 		int add_stream(std::shared_ptr<Audio_Stream> stream);
+		void collect_streams();
 
 		const std::map<int, std::pair<int,std::string>>& get_driver_list() const { return driver_list; }
 		const std::map<int, std::string>& get_device_list() const { return device_list; }
@@ -116,7 +68,7 @@ class Audio_Manager
 		int open_device();
 		void close_device();
 
-		static int16_t clip16(int32_t input);
+		void update_volume();
 
 		static uint32_t callback(void* drv_struct, void* user_param, uint32_t buf_size, void* data);
 
@@ -124,12 +76,15 @@ class Audio_Manager
 		int driver_id;  // Actual driver id, -1 if not loaded
 		int device_id;  // Actual device id, -1 if not loaded
 
+		const static unsigned int mix_buffer_size;
+		const static unsigned int max_streams;
+
 		uint32_t sample_rate;
-		uint32_t sample_size;
+		Sample_Converter converter;	// only changed while the device is closed
 
 		float volume;
-		int32_t converted_volume;
-		std::vector<std::shared_ptr<Audio_Stream>> streams;
+		bool volume_pending;
+		Audio_Mixer mixer;
 
 		void* window_handle;
 		void* driver_handle;
@@ -142,7 +97,7 @@ class Audio_Manager
 		std::map<int, std::pair<int,std::string>> driver_list;
 		std::map<int, std::string> device_list;
 
-		std::mutex mutex;
+		std::mutex mutex; // not used by the audio thread
 };
 
 #endif
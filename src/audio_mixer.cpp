@@ -0,0 +1,136 @@
+#include "audio_mixer.h"
+#include "sample_converter.h"
+
+#include <algorithm>
+
+//! Gain that leaves the output unchanged.
+const int32_t Audio_Mixer::unity_gain = 0x10000;
+//! Length of volume changes, in samples.
+const int32_t Audio_Mixer::volume_ramp_length = 256;
+
+//! Create a mixer. All memory used by the audio thread is allocated here.
+/*!
+ *  \param max_samples Size of the mix buffer.
+ *  \param max_streams Number of streams that can be played at the same time.
+ */
+Audio_Mixer::Audio_Mixer(unsigned int max_samples, unsigned int max_streams)
+	: buffer(max_samples, {0, 0})
+	, active(max_streams)
+	, active_count(0)
+	, add_queue(max_streams)
+	, retire_queue(max_streams)
+	, volume_queue(16)
+	, gain(unity_gain)
+	, gain_step(0)
+	, target_gain(unity_gain)
+	, ramp_remaining(0)
+{
+}
+
+//! Hand a stream to the audio thread.
+/*!
+ *  The stream must already be set up.
+ *
+ *  \return false if too many streams are waiting to be started.
+ */
+bool Audio_Mixer::add_stream(std::shared_ptr<Audio_Stream> stream)
+{
+	return add_queue.push(std::move(stream));
+}
+
+//! Change the output volume.
+/*!
+ *  \param new_gain Gain in 16.16 fixed point. unity_gain leaves the
+ *         output unchanged.
+ *  \return false if too many volume changes are waiting. Try again later.
+ */
+bool Audio_Mixer::set_volume(int32_t new_gain)
+{
+	return volume_queue.push(new_gain < 0 ? 0 : new_gain);
+}
+
+//! Stop and release finished streams.
+/*!
+ *  Call this regularly from a non-audio thread. Messages recorded by the
+ *  streams during playback are printed here.
+ *
+ *  \return the number of streams released.
+ */
+unsigned int Audio_Mixer::collect()
+{
+	unsigned int count = 0;
+	std::shared_ptr<Audio_Stream> stream;
+	while(retire_queue.pop(stream))
+	{
+		stream->stop_stream();
+		stream->log_events();
+		stream.reset();
+		count++;
+	}
+	return count;
+}
+
+//! Mix all streams.
+/*!
+ *  \param count Number of samples, at most get_max_samples().
+ *  \return the mix buffer. It is valid until the next call.
+ */
+const WAVE_32BS* Audio_Mixer::mix(unsigned int count)
+{
+	count = std::min<unsigned int>(count, buffer.size());
+
+	// Start new streams
+	while(active_count < active.size() && add_queue.pop(active[active_count]))
+		active_count++;
+
+	std::fill_n(buffer.begin(), count, WAVE_32BS{0, 0});
+
+	for(unsigned int i = 0; i < active_count;)
+	{
+		Audio_Stream* stream = active[i].get();
+		if(!stream->get_finished())
+			stream->get_sample(buffer.data(), count, 2);
+
+		// Hand finished streams back. If the queue is full, try again next time.
+		if(stream->get_finished() && retire_queue.push(std::move(active[i])))
+		{
+			active[i] = std::move(active[--active_count]);
+			continue;
+		}
+		i++;
+	}
+
+	apply_volume(count);
+	return buffer.data();
+}
+
+//! Apply the output volume to the mix buffer.
+/*!
+ *  Only the latest queued volume is used. The gain is ramped linearly
+ *  from the current value over volume_ramp_length samples.
+ */
+void Audio_Mixer::apply_volume(unsigned int count)
+{
+	int32_t new_gain;
+	bool changed = false;
+	while(volume_queue.pop(new_gain))
+		changed = true;
+	if(changed && new_gain != target_gain)
+	{
+		target_gain = new_gain;
+		ramp_remaining = volume_ramp_length;
+		gain_step = (target_gain - gain) / volume_ramp_length;
+	}
+
+	unsigned int i = 0;
+	for(; i < count && ramp_remaining; i++)
+	{
+		gain += gain_step;
+		if(!--ramp_remaining)
+			gain = target_gain;
+		buffer[i].L = ((int64_t)buffer[i].L * gain) >> 16;
+		buffer[i].R = ((int64_t)buffer[i].R * gain) >> 16;
+	}
+	if(gain != unity_gain)
+		Sample_Converter::apply_gain(&buffer[i], count - i, gain);
+}
@@ -0,0 +1,62 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <memory>
+#include <vector>
+
+#include "audio_stream.h"
+#include "spsc_queue.h"
+
+//! Real-time safe mixer for audio streams.
+/*!
+ *  mix() is called from the audio thread. It does not lock, allocate or
+ *  free memory, or print anything.
+ *
+ *  New streams are handed to the audio thread through a lock-free queue.
+ *  Finished streams are handed back through another queue, and are
+ *  stopped and released by collect() on a non-audio thread.
+ *
+ *  Volume changes are queued the same way. They take effect at the
+ *  start of the next mix() call and are ramped to avoid clicks.
+ *
+ *  add_stream(), set_volume() and collect() must be called from the same
+ *  thread, or be protected by a mutex that the audio thread does not take.
+ */
+class Audio_Mixer
+{
+	public:
+		Audio_Mixer(unsigned int max_samples, unsigned int max_streams);
+
+		// control thread
+		bool add_stream(std::shared_ptr<Audio_Stream> stream);
+		bool set_volume(int32_t new_gain);
+		unsigned int collect();
+
+		// audio thread
+		const WAVE_32BS* mix(unsigned int count);
+
+		//! Get the maximum number of samples that can be mixed in one call.
+		inline unsigned int get_max_samples() const { return buffer.size(); }
+
+		const static int32_t unity_gain;
+		const static int32_t volume_ramp_length;
+
+	private:
+		void apply_volume(unsigned int count);
+
+		std::vector<WAVE_32BS> buffer;
+		std::vector<std::shared_ptr<Audio_Stream>> active;	// only accessed by the audio thread
+		unsigned int active_count;
+
+		Spsc_Queue<std::shared_ptr<Audio_Stream>> add_queue;
+		Spsc_Queue<std::shared_ptr<Audio_Stream>> retire_queue;
+		Spsc_Queue<int32_t> volume_queue;
+
+		// only accessed by the audio thread
+		int32_t gain;
+		int32_t gain_step;
+		int32_t target_gain;
+		int32_t ramp_remaining;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(LOCAL_LIBVGM)
+#include "emu/EmuStructs.h"
+#else
+#include <vgm/emu/EmuStructs.h>
+#endif
+
+//! Abstract class for audio stream control
+class Audio_Stream
+{
+	public:
+		inline Audio_Stream()
+			: finished(false)
+		{}
+
+		inline virtual ~Audio_Stream()
+		{}
+
+		//! called by Audio_Manager when starting the stream.
+		/*!
+		 *  setup your resamplers and stuff here.
+		 */
+		virtual void setup_stream(uint32_t sample_rate) = 0;
+
+		//! called by Audio_Manager during stream update.
+		/*!
+		 *  return zero to indicate that the stream should be stopped.
+		 */
+		virtual int get_sample(WAVE_32BS* output, int count, int channels) = 0;
+
+		//! called by Audio_Manager when stopping the stream.
+		/*!
+		 *  resamplers should be cleaned up, but the playback may start again
+		 *  so the "finished" state should not be updated here.
+		 */
+		virtual void stop_stream() = 0;
+
+		//! called by Audio_Manager after stopping the stream.
+		/*!
+		 *  this is never called from the audio thread. print messages
+		 *  for anything that happened during playback here, instead of
+		 *  printing from get_sample().
+		 */
+		inline virtual void log_events()
+		{}
+
+		//! get the "finished" flag status
+		/*!
+		 *  when set, the audio manager will stop mixing this stream and
+		 *  destroy its pointer.
+		 */
+		inline void set_finished(bool flag)
+		{
+			finished = flag;
+		}
+
+		//! get the "finished" flag status
+		/*!
+		 *  when set, the audio manager will stop mixing this stream and
+		 *  destroy its pointer.
+		 */
+		inline bool get_finished()
+		{
+			return finished;
+		}
+
+	protected:
+		std::atomic<bool> finished; // may be set from the UI thread while the stream is playing
+};
+
+#endif
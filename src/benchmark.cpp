@@ -0,0 +1,592 @@
+#include "benchmark.h"
+#include "headless.h"
+#include "song_manager.h"
+#include "source_text.h"
+#include "compile_profiler.h"
+#include "thread_pool.h"
+#include "line_map.h"
+#include "track_info.h"
+#include "timeline_index.h"
+#include "offline_renderer.h"
+#include "sample_converter.h"
+
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <sstream>
+#include <functional>
+#include <vector>
+#include <map>
+
+//! Each measurement is repeated this many times and the fastest run is reported.
+static const unsigned int runs = 5;
+
+//! Get the fastest of several runs of a function, in seconds.
+static double best_time(const std::function<void()>& func)
+{
+	double best = 0;
+	for(unsigned int run = 0; run < runs; run++)
+	{
+		auto start_time = std::chrono::steady_clock::now();
+		func();
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+		if(!run || time < best)
+			best = time;
+	}
+	return best;
+}
+
+//! Get the longest track length, in ticks.
+static int get_song_ticks(const Song_Manager::Compile_Snapshot& snapshot)
+{
+	int length = 0;
+	for(auto && i : *snapshot.tracks)
+		length = std::max(length, (int)i.second.length);
+	return length;
+}
+
+//! Measure the edit-to-result latency of an MML file.
+/*!
+ *  The file is compiled, compiled again unchanged, and then a line near the
+ *  end of the file is edited several times, like when typing. Each edit
+ *  parses the entire file again. Allocation counts are only printed when
+ *  built with MMLGUI_PROFILE_ALLOC.
+ */
+static int benchmark_compile(const Benchmark_Options& options)
+{
+	const unsigned int edits = 20;
+
+	std::string str;
+	if(!read_file(options.input, str))
+		return 1;
+
+	Song_Manager song_manager;
+	auto print = [&](const char* name, const Song_Manager::Compile_Snapshot& snapshot)
+	{
+		auto profile = Compile_Profiler::get().get_history().back();
+		printf("%-14s %9.3f ms latency, %9.3f ms parsing, %u/%u lines parsed",
+			name,
+			snapshot.compile_latency / 1000.0,
+			profile.time[Compile_Profiler::PHASE_PARSE] / 1000.0,
+			profile.parsed_lines,
+			profile.line_count);
+		if(Compile_Profiler::counts_allocations)
+		{
+			uint64_t allocations = 0;
+			for(int phase = 0; phase < Compile_Profiler::PHASE_COUNT; phase++)
+				allocations += profile.allocations[phase];
+			printf(", %llu allocations (%llu in diff)", (unsigned long long)allocations,
+				(unsigned long long)profile.allocations[Compile_Profiler::PHASE_DIFF]);
+		}
+		printf("\n");
+	};
+
+	auto text = std::make_shared<const Source_Text>(str);
+	auto snapshot = compile_and_wait(song_manager, text, options.input);
+	if(!snapshot)
+		return 1;
+	if(!snapshot->successful)
+	{
+		fprintf(stderr, "%s\n", snapshot->error_message.c_str());
+		return 1;
+	}
+	auto profile = Compile_Profiler::get().get_history().back();
+	printf("Compiling %s: %u lines, %u tracks, %u events\n", options.input, profile.line_count, profile.track_count, profile.event_count);
+	print("full", *snapshot);
+
+	snapshot = compile_and_wait(song_manager, text, options.input);
+	if(!snapshot)
+		return 1;
+	print("unchanged", *snapshot);
+
+	// Append spaces to a line near the end, which does not change the song.
+	unsigned int line = text->get_line_count() * 9 / 10;
+	std::size_t line_end = (text->get_line_count()) ? text->get_line(line) - text->get_text().data() + text->get_line_length(line) : 0;
+	double total_latency = 0;
+	for(unsigned int i = 0; i < edits; i++)
+	{
+		std::string edited = str;
+		edited.insert(line_end, 1 + (i & 1), ' ');
+		snapshot = compile_and_wait(song_manager, std::make_shared<const Source_Text>(std::move(edited)), options.input);
+		if(!snapshot)
+			return 1;
+		if(i == 0)
+			print("first edit", *snapshot);
+		else
+			total_latency += snapshot->compile_latency;
+	}
+	print("last edit", *snapshot);
+	printf("%-14s %9.3f ms latency\n", "edit average", total_latency / 1000.0 / (edits - 1));
+	return 0;
+}
+
+//! Compare the Line_Map with a copy of the track position map for each line.
+static int benchmark_line_map(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	auto profile = Compile_Profiler::get().get_history().back();
+	auto& lines = *snapshot->lines;
+	auto start_time = std::chrono::steady_clock::now();
+	std::map<int, Line_Map::Track_Position_Map> line_copies;
+	std::size_t copy_size = 0;
+	for(int i = 0; i < lines.get_line_count(); i++)
+	{
+		auto map = lines.at(i);
+		// approximate size of a red-black tree node
+		copy_size += sizeof(map) + map.size() * (sizeof(Line_Map::Track_Position_Map::value_type) + 4 * sizeof(void*));
+		line_copies.emplace_hint(line_copies.end(), i, std::move(map));
+	}
+	copy_size += line_copies.size() * (sizeof(Line_Map::Track_Position_Map) + sizeof(int) + 4 * sizeof(void*));
+	double copy_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	printf("%-14s %9.3f ms, %9zu bytes, %zu track positions\n", "line map",
+		profile.time[Compile_Profiler::PHASE_LINE_MAP] / 1000.0, lines.get_memory_usage(), lines.get_position_count());
+	printf("%-14s %9.3f ms, %9zu bytes (estimated)\n", "map per line", copy_time * 1000.0, copy_size);
+	return 0;
+}
+
+//! Generate Track_Info for all tracks on one thread and on the thread pool.
+static int benchmark_track_info(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	std::vector<Track*> track_list;
+	for(auto && i : *snapshot->tracks)
+		track_list.push_back(&snapshot->song->get_track(i.first));
+
+	auto generate_tracks = [&](Thread_Pool& pool)
+	{
+		return best_time([&]()
+		{
+			Ref_Pool ref_pool;
+			std::vector<std::unique_ptr<Track_Info_Generator>> generators(track_list.size());
+			pool.run(track_list.size(), [&](unsigned int index)
+			{
+				generators[index] = std::make_unique<Track_Info_Generator>(*snapshot->song, *track_list[index], ref_pool);
+			});
+		});
+	};
+	Thread_Pool single_thread(1);
+	double single_time = generate_tracks(single_thread);
+	double pool_time = generate_tracks(Thread_Pool::get());
+	printf("%-14s %9.3f ms on 1 thread, %9.3f ms on %u threads (%.2fx)\n", "track info",
+		single_time * 1000.0, pool_time * 1000.0, Thread_Pool::get().get_thread_count(),
+		(pool_time > 0) ? single_time / pool_time : 0);
+	return 0;
+}
+
+//! Compare the text hand-off with copying the text and using one string per line.
+/*!
+ *  Allocation counts are only printed when built with MMLGUI_PROFILE_ALLOC.
+ */
+static int benchmark_text(const Benchmark_Options& options)
+{
+	std::string str;
+	if(!read_file(options.input, str))
+		return 1;
+
+	auto time_text = [&](const char* name, std::function<void()> func)
+	{
+		uint64_t allocations = 0;
+		double time = best_time([&]()
+		{
+			auto start_allocations = Compile_Profiler::get_thread_allocations();
+			func();
+			allocations = Compile_Profiler::get_thread_allocations() - start_allocations;
+		});
+		printf("%-14s %9.3f ms", name, time * 1000.0);
+		if(Compile_Profiler::counts_allocations)
+			printf(", %llu allocations", (unsigned long long)allocations);
+		printf("\n");
+	};
+	std::size_t text_size = 0;
+	time_text("text copy", [&]()
+	{
+		std::string job_buffer = str;
+		std::stringstream stream(job_buffer);
+		std::string line;
+		while(std::getline(stream, line))
+		{
+			std::string expanded;
+			Song_Manager::tabs_to_spaces(line.data(), line.size(), expanded);
+			text_size += expanded.size();
+		}
+	});
+	time_text("text shared", [&]()
+	{
+		std::string job_buffer = str;
+		auto shared_text = std::make_shared<const Source_Text>(std::move(job_buffer));
+		std::string line_buffer;
+		for(unsigned int i = 0; i < shared_text->get_line_count(); i++)
+		{
+			Song_Manager::tabs_to_spaces(shared_text->get_line(i), shared_text->get_line_length(i), line_buffer);
+			text_size += line_buffer.size();
+		}
+	});
+	return 0;
+}
+
+//! Step through the song one screen at a time, like scrolling the track view.
+/*!
+ *  The events on the screen are read once by copying each event, and once
+ *  with the per-attribute accessors.
+ */
+static int benchmark_scroll(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	int scroll_length = get_song_ticks(*snapshot);
+	auto scroll_tracks = [&](bool copy_events)
+	{
+		const int screen_length = 384;
+		const unsigned int max_spans = 16;
+		Track_Info::Span spans[max_spans];
+		unsigned int checksum = 0;
+		double time = best_time([&]()
+		{
+			checksum = 0;
+			for(int start = 0; start < scroll_length; start += screen_length / 8)
+			{
+				for(auto && i : *snapshot->tracks)
+				{
+					auto& events = i.second.events;
+					unsigned int span_count = i.second.events_in_range(start, start + screen_length, spans, max_spans);
+					for(unsigned int span = 0; span < span_count; span++)
+					{
+						for(auto index = spans[span].first; index < spans[span].last; index++)
+						{
+							if(copy_events)
+							{
+								auto event = events.get(index);
+								checksum += event.first + event.second.on_time + event.second.note;
+							}
+							else
+							{
+								checksum += events.get_time(index) + events.get_on_time(index) + events.get_note(index);
+							}
+						}
+					}
+				}
+			}
+		});
+		return std::make_pair(time, checksum);
+	};
+	auto scroll_copy = scroll_tracks(true);
+	auto scroll_columns = scroll_tracks(false);
+	printf("%-14s %9.3f ms copying events, %9.3f ms with accessors (checksum %s)\n", "scroll",
+		scroll_copy.first * 1000.0, scroll_columns.first * 1000.0,
+		(scroll_copy.second == scroll_columns.second) ? "ok" : "mismatch");
+	return 0;
+}
+
+//! Find the notes sounding at evenly spaced song positions.
+/*!
+ *  The queries are done with the timeline index and by scanning every track.
+ *  The time to build the index is also reported.
+ */
+static int benchmark_timeline(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	int song_length = get_song_ticks(*snapshot);
+	auto find_notes = [&](bool use_index)
+	{
+		const int queries = 1000;
+		int step = std::max(1, song_length / queries);
+		std::vector<Timeline_Index::Result> results;
+		std::size_t result_count = 0;
+		double time = best_time([&]()
+		{
+			result_count = 0;
+			for(int time = 0; time < song_length; time += step)
+			{
+				results.clear();
+				if(use_index)
+					snapshot->timeline->find(time, results);
+				else
+					Timeline_Index::scan(*snapshot->tracks, time, time + 1, results);
+				result_count += results.size();
+			}
+		});
+		return std::make_pair(time, result_count);
+	};
+	std::size_t note_count = 0;
+	double index_time = best_time([&]()
+	{
+		Timeline_Index timeline(*snapshot->tracks);
+		note_count = timeline.size();
+	});
+	auto find_index = find_notes(true);
+	auto find_scan = find_notes(false);
+	printf("%-14s %9.3f ms to index %zu notes, %9.3f ms with index, %9.3f ms scanning (results %s)\n", "timeline",
+		index_time * 1000.0, note_count, find_index.first * 1000.0, find_scan.first * 1000.0,
+		(find_index.second == find_scan.second) ? "ok" : "mismatch");
+	return 0;
+}
+
+//! Render a song without writing a file and print the CPU time per second of audio.
+/*!
+ *  \param max_block_size See Emu_Player::set_max_block_size().
+ *  \param time_streams Also print the time spent in DAC stream updates.
+ */
+static bool measure_render(const char* name, const Song_Manager::Compile_Snapshot& snapshot,
+	const Benchmark_Options& options, double length, int max_block_size, bool time_streams)
+{
+	try
+	{
+		Offline_Renderer renderer(snapshot.song, options.sample_rate);
+		renderer.set_length(length);
+		renderer.set_max_block_size(max_block_size);
+		renderer.set_time_streams(time_streams);
+		std::clock_t start_time = std::clock();
+		if(!renderer.render(""))
+		{
+			fprintf(stderr, "%s\n", renderer.get_error_message().c_str());
+			return false;
+		}
+		double cpu_time = (double)(std::clock() - start_time) / CLOCKS_PER_SEC;
+		double rendered_length = renderer.get_rendered_length();
+		uint64_t blocks = renderer.get_block_count();
+		printf("%-10s %9.3f ms CPU per second of audio, %8.1fx real time, %8.1f samples per block, %llu driver steps\n",
+			name,
+			(rendered_length > 0) ? cpu_time * 1000.0 / rendered_length : 0,
+			renderer.get_realtime_factor(),
+			blocks ? rendered_length * options.sample_rate / blocks : 0,
+			(unsigned long long)renderer.get_driver_steps());
+		if(time_streams)
+		{
+			uint64_t dac_writes = renderer.get_dac_writes();
+			printf("%-10s %9.3f ms per second of audio in DAC streams, %llu DAC writes, %.1f ns per write\n",
+				"",
+				(rendered_length > 0) ? renderer.get_stream_time() * 1000.0 / rendered_length : 0,
+				(unsigned long long)dac_writes,
+				dac_writes ? renderer.get_stream_time() * 1e9 / dac_writes : 0);
+		}
+		return true;
+	}
+	catch(std::exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return false;
+	}
+}
+
+//! Compare block rendering with rendering the sound chips one sample at a time.
+/*!
+ *  Rendering one sample at a time is how the chips were rendered before
+ *  block rendering was added.
+ */
+static int benchmark_render(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	double length = options.length;
+	if(length <= 0)
+		length = Offline_Renderer::get_song_length(*snapshot->tracks, *snapshot->tempo_map);
+
+	printf("Rendering %.3f s of audio at %d Hz\n", length, options.sample_rate);
+	if(!measure_render("per sample", *snapshot, options, length, 1, false)
+		|| !measure_render("blocks", *snapshot, options, length, 0, false))
+		return 1;
+	return 0;
+}
+
+//! Measure the time spent in DAC stream updates, to show the cost of PCM playback.
+/*!
+ *  The clock is read around each stream update, which adds some overhead
+ *  to the render.
+ */
+static int benchmark_dac(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	double length = options.length;
+	if(length <= 0)
+		length = Offline_Renderer::get_song_length(*snapshot->tracks, *snapshot->tempo_map);
+
+	printf("Rendering %.3f s of audio at %d Hz\n", length, options.sample_rate);
+	if(!measure_render("streams", *snapshot, options, length, 0, true))
+		return 1;
+	return 0;
+}
+
+//! Measure how stem rendering scales with the number of threads.
+/*!
+ *  All stems of an MML file are rendered without writing files, using 1,
+ *  2, 4, ... threads up to the --compile-threads setting (by default, the
+ *  number of hardware threads). The wall clock time, the speedup over one
+ *  thread and the parallel efficiency are reported.
+ */
+static int benchmark_stems(const Benchmark_Options& options)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, options.input);
+	if(!snapshot)
+		return 1;
+
+	double length = options.length;
+	if(length <= 0)
+		length = Offline_Renderer::get_song_length(*snapshot->tracks, *snapshot->tempo_map);
+
+	std::vector<std::map<int16_t,uint32_t>> masks;
+	for(auto && i : *snapshot->tracks)
+	{
+		auto mask = song_manager.get_solo_mask(i.first);
+		if(!mask.empty())
+			masks.push_back(mask);
+	}
+
+	unsigned int max_threads = Thread_Pool::get().get_thread_count();
+	printf("Rendering %d stems of %.3f s at %d Hz, up to %d threads\n",
+		(int)masks.size(), length, options.sample_rate, max_threads);
+
+	double single_thread_time = 0;
+	for(unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads))
+	{
+		std::vector<Offline_Renderer> renderers;
+		try
+		{
+			for(auto && mask : masks)
+			{
+				renderers.emplace_back(snapshot->song, options.sample_rate);
+				renderers.back().set_length(length);
+				renderers.back().set_mute_mask(mask);
+			}
+		}
+		catch(std::exception& e)
+		{
+			fprintf(stderr, "%s\n", e.what());
+			return 1;
+		}
+
+		Thread_Pool pool(threads);
+		auto start_time = std::chrono::steady_clock::now();
+		pool.run(renderers.size(), [&](unsigned int i)
+		{
+			renderers[i].render("");
+		});
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+		for(auto && renderer : renderers)
+		{
+			if(renderer.get_error_message().size())
+			{
+				fprintf(stderr, "%s\n", renderer.get_error_message().c_str());
+				return 1;
+			}
+		}
+
+		if(threads == 1)
+			single_thread_time = time;
+		double speedup = (time > 0) ? single_thread_time / time : 0;
+		printf("%3d threads %9.3f ms, %5.2fx speedup, %5.1f%% efficiency\n",
+			threads, time * 1000.0, speedup, speedup * 100.0 / threads);
+		if(threads == max_threads)
+			break;
+	}
+	return 0;
+}
+
+//! Measure the speed of the sample conversion kernels.
+static int benchmark_formats(const Benchmark_Options& options)
+{
+	const unsigned int block_size = 4096;
+	const unsigned int seconds = 60;
+	std::vector<WAVE_32BS> input(block_size);
+	for(unsigned int i = 0; i < block_size; i++)
+		input[i] = {(int32_t)(i * 2654435761u) >> 7, (int32_t)(i * 40503u) << 8};
+	std::vector<uint8_t> output(block_size * 8);
+
+	auto measure = [&](const char* name, uint32_t rate, const std::function<void()>& kernel)
+	{
+		uint64_t blocks = (uint64_t)rate * seconds / block_size;
+		auto start_time = std::chrono::steady_clock::now();
+		for(uint64_t i = 0; i < blocks; i++)
+			kernel();
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+		printf("%6d Hz %-12s %8.3f ms per second of audio, %8.0fx real time\n",
+			rate, name, time * 1000.0 / seconds, (time > 0) ? seconds / time : 0);
+	};
+
+	WAVE_32BS* in = input.data();
+	void* out = output.data();
+	printf("Converting %d s of stereo audio, SIMD %s, SSE4.1 %s\n", seconds,
+		Sample_Converter::simd_enabled ? "enabled" : "disabled",
+		Sample_Converter::sse41_enabled ? "enabled" : "disabled");
+	for(uint32_t rate : {48000, 96000})
+	{
+		measure("s16", rate, [&]() { Sample_Converter::to_s16(in, (int16_t*)out, block_size); });
+		measure("s16 scalar", rate, [&]() { Sample_Converter::to_s16_scalar(in, (int16_t*)out, block_size); });
+		measure("s24", rate, [&]() { Sample_Converter::to_s24(in, (uint8_t*)out, block_size); });
+		measure("s24 scalar", rate, [&]() { Sample_Converter::to_s24_scalar(in, (uint8_t*)out, block_size); });
+		measure("f32", rate, [&]() { Sample_Converter::to_f32(in, (float*)out, block_size); });
+		measure("f32 scalar", rate, [&]() { Sample_Converter::to_f32_scalar(in, (float*)out, block_size); });
+		// unity gain, so the input is unchanged
+		measure("gain", rate, [&]() { Sample_Converter::apply_gain(in, block_size, 0x10000); });
+		measure("gain scalar", rate, [&]() { Sample_Converter::apply_gain_scalar(in, block_size, 0x10000); });
+	}
+	return 0;
+}
+
+//! Benchmarks that can be run from the command line.
+static const struct
+{
+	const char* name;
+	int (*function)(const Benchmark_Options& options);
+	bool needs_input;
+} benchmarks[] = {
+	{"compile", benchmark_compile, true},
+	{"line-map", benchmark_line_map, true},
+	{"track-info", benchmark_track_info, true},
+	{"text", benchmark_text, true},
+	{"scroll", benchmark_scroll, true},
+	{"timeline", benchmark_timeline, true},
+	{"render", benchmark_render, true},
+	{"dac", benchmark_dac, true},
+	{"stems", benchmark_stems, true},
+	{"formats", benchmark_formats, false},
+};
+
+//! Run a benchmark by name.
+/*!
+ *  \return the exit status for the program. Non-zero if the benchmark does
+ *          not exist, an MML file is needed but not given, or the benchmark
+ *          failed.
+ */
+int run_benchmark(const std::string& name, const Benchmark_Options& options)
+{
+	for(auto && benchmark : benchmarks)
+	{
+		if(name != benchmark.name)
+			continue;
+		if(benchmark.needs_input && !options.input)
+		{
+			fprintf(stderr, "Benchmark '%s' needs an MML file\n", benchmark.name);
+			return 1;
+		}
+		return benchmark.function(options);
+	}
+	fprintf(stderr, "Unknown benchmark '%s'. Available benchmarks:", name.c_str());
+	for(auto && benchmark : benchmarks)
+		fprintf(stderr, " %s", benchmark.name);
+	fprintf(stderr, "\n");
+	return 1;
+}
@@ -0,0 +1,17 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <cstdint>
+
+//! Options for the command line benchmarks.
+struct Benchmark_Options
+{
+	const char* input;			// MML file, for benchmarks that need one
+	uint32_t sample_rate;
+	double length;				// seconds to render, 0 for the song length
+};
+
+int run_benchmark(const std::string& name, const Benchmark_Options& options);
+
+#endif
@@ -0,0 +1,185 @@
+#include "compile_profiler.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+// Number of profiles to keep
+const unsigned int Compile_Profiler::max_history = 64;
+
+//=====================================================================
+// Allocation counting
+
+static thread_local uint64_t thread_allocations = 0;
+
+#ifdef MMLGUI_PROFILE_ALLOC
+// Replacing the global operator new affects every allocation in the program,
+// so it is only done in builds with allocation profiling enabled.
+void* operator new(std::size_t size)
+{
+	thread_allocations++;
+	if(size == 0)
+		size = 1;
+	while(true)
+	{
+		void* ptr = std::malloc(size);
+		if(ptr)
+			return ptr;
+		std::new_handler handler = std::get_new_handler();
+		if(!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+const bool Compile_Profiler::counts_allocations = true;
+#else
+const bool Compile_Profiler::counts_allocations = false;
+#endif
+
+//=====================================================================
+Compile_Profiler::Timer::Timer()
+{
+	restart();
+}
+
+//! Restart the measurement.
+void Compile_Profiler::Timer::restart()
+{
+	start_time = std::chrono::steady_clock::now();
+	start_allocations = thread_allocations;
+}
+
+//! Add the time and allocations since the last restart to a phase.
+/*!
+ *  The timer is restarted, so that the next phase can be measured
+ *  directly afterwards.
+ */
+void Compile_Profiler::Timer::stop(Profile& profile, Phase phase)
+{
+	auto now = std::chrono::steady_clock::now();
+	profile.time[phase] += std::chrono::duration_cast<std::chrono::microseconds>(now - start_time).count();
+	profile.allocations[phase] += thread_allocations - start_allocations;
+	start_time = now;
+	start_allocations = thread_allocations;
+}
+
+//=====================================================================
+Compile_Profiler::Compile_Profiler()
+{
+}
+
+//! Get the profiler instance.
+Compile_Profiler& Compile_Profiler::get()
+{
+	static Compile_Profiler instance;
+	return instance;
+}
+
+//! Get the name of a phase. Used for display and JSON output.
+const char* Compile_Profiler::get_phase_name(Phase phase)
+{
+	switch(phase)
+	{
+		case PHASE_DIFF:
+			return "diff";
+		case PHASE_PARSE:
+			return "parse";
+		case PHASE_LINE_MAP:
+			return "line_map";
+		case PHASE_TABLES:
+			return "tables";
+		case PHASE_TRACK_INFO:
+			return "track_info";
+		case PHASE_PUBLISH:
+			return "publish";
+		default:
+			return "unknown";
+	}
+}
+
+//! Get the number of allocations made by the calling thread.
+/*!
+ *  Always 0 unless built with MMLGUI_PROFILE_ALLOC.
+ */
+uint64_t Compile_Profiler::get_thread_allocations()
+{
+	return thread_allocations;
+}
+
+//! Add a profile to the history. The oldest profile is removed if the history is full.
+void Compile_Profiler::add(const Profile& profile)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	history.push_back(profile);
+	while(history.size() > max_history)
+		history.pop_front();
+}
+
+//! Clear the history.
+void Compile_Profiler::clear()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	history.clear();
+}
+
+//! Get a copy of the history, oldest profile first.
+std::vector<Compile_Profiler::Profile> Compile_Profiler::get_history() const
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	return std::vector<Profile>(history.begin(), history.end());
+}
+
+//! Get the history as a JSON string.
+std::string Compile_Profiler::to_json() const
+{
+	auto profiles = get_history();
+	std::string str = "{\n\t\"allocations_counted\": " + std::string(counts_allocations ? "true" : "false") + ",\n";
+	str += "\t\"profiles\": [";
+	for(unsigned int i = 0; i < profiles.size(); i++)
+	{
+		const Profile& p = profiles[i];
+		str += (i ? ",\n" : "\n");
+		str += "\t\t{\n";
+		str += "\t\t\t\"generation\": " + std::to_string(p.generation) + ",\n";
+		str += "\t\t\t\"successful\": " + std::string(p.successful ? "true" : "false") + ",\n";
+		str += "\t\t\t\"cancelled\": " + std::string(p.cancelled ? "true" : "false") + ",\n";
+		str += "\t\t\t\"reused\": " + std::string(p.reused ? "true" : "false") + ",\n";
+		str += "\t\t\t\"line_count\": " + std::to_string(p.line_count) + ",\n";
+		str += "\t\t\t\"parsed_lines\": " + std::to_string(p.parsed_lines) + ",\n";
+		str += "\t\t\t\"track_count\": " + std::to_string(p.track_count) + ",\n";
+		str += "\t\t\t\"event_count\": " + std::to_string(p.event_count) + ",\n";
+		str += "\t\t\t\"total_time_us\": " + std::to_string(p.total_time) + ",\n";
+		str += "\t\t\t\"background_passes\": " + std::to_string(p.background_passes) + ",\n";
+		str += "\t\t\t\"background_time_us\": " + std::to_string(p.background_time) + ",\n";
+		str += "\t\t\t\"phases\": {";
+		for(int phase = 0; phase < PHASE_COUNT; phase++)
+		{
+			str += (phase ? ",\n" : "\n");
+			str += "\t\t\t\t\"" + std::string(get_phase_name((Phase)phase)) + "\": { "
+				+ "\"time_us\": " + std::to_string(p.time[phase]) + ", "
+				+ "\"allocations\": " + std::to_string(p.allocations[phase]) + " }";
+		}
+		str += "\n\t\t\t}\n\t\t}";
+	}
+	str += "\n\t]\n}\n";
+	return str;
+}
+
+//! Write the history to a JSON file.
+/*!
+ *  \return false if the file could not be written.
+ */
+bool Compile_Profiler::write_json(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+	out << to_json();
+	return out.good();
+}
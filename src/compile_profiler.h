@@ -0,0 +1,93 @@
+#ifndef COMPILE_PROFILER_H
+#define COMPILE_PROFILER_H
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+//! Records timing and allocation statistics for each phase of a compile job.
+/*!
+ *  Song_Manager adds a profile after each compile job. A limited number of
+ *  profiles is kept, so the history can be displayed in the debug window
+ *  or written to a JSON file.
+ *
+ *  Allocations are counted by replacing the global operator new, using a
+ *  per-thread counter. This is only done when built with
+ *  MMLGUI_PROFILE_ALLOC defined, otherwise allocation counts are always 0.
+ */
+class Compile_Profiler
+{
+	public:
+		enum Phase
+		{
+			PHASE_DIFF = 0,		// compare input with the previous input
+			PHASE_PARSE,		// MML parsing
+			PHASE_LINE_MAP,		// Line_Map building
+			PHASE_TABLES,		// length tables and cursor index
+			PHASE_TRACK_INFO,	// Track_Info generation
+			PHASE_PUBLISH,		// hand-off of the result to the UI thread
+			PHASE_COUNT
+		};
+
+		//! Statistics for one compile job.
+		struct Profile
+		{
+			unsigned int generation;
+			bool successful;
+			bool cancelled;
+			bool reused;						// input was unchanged, previous result was published again
+
+			unsigned int time[PHASE_COUNT];		// wall time in microseconds
+			uint64_t allocations[PHASE_COUNT];
+
+			unsigned int line_count;			// lines in the input
+			unsigned int parsed_lines;			// lines read by the MML parser
+			unsigned int track_count;
+			unsigned int event_count;			// total events in all tracks
+			unsigned int total_time;			// time from request to result, in microseconds
+			unsigned int background_passes;		// Track_Info passes after the first result
+			unsigned int background_time;		// time spent in background passes, in microseconds
+		};
+
+		//! Measures the time and allocations of the calling thread.
+		class Timer
+		{
+			public:
+				Timer();
+				void restart();
+				void stop(Profile& profile, Phase phase);
+
+			private:
+				std::chrono::steady_clock::time_point start_time;
+				uint64_t start_allocations;
+		};
+
+		// not copyable
+		Compile_Profiler(Compile_Profiler const&) = delete;
+		void operator=(Compile_Profiler const&) = delete;
+
+		static Compile_Profiler& get();
+		static const char* get_phase_name(Phase phase);
+		static uint64_t get_thread_allocations();
+
+		void add(const Profile& profile);
+		void clear();
+		std::vector<Profile> get_history() const;
+
+		std::string to_json() const;
+		bool write_json(const std::string& filename) const;
+
+		const static unsigned int max_history;
+		const static bool counts_allocations;
+
+	private:
+		Compile_Profiler();
+
+		mutable std::mutex mutex;
+		std::deque<Profile> history;
+};
+
+#endif
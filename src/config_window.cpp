@@ -1,5 +1,6 @@
 #include "imgui.h"
 #include "config_window.h"
+#include "audio_manager.h"
 
 //=====================================================================
 Config_Window::Config_Window()
@@ -88,10 +89,11 @@ void Config_Window::show_emu_tab()
 
 void Config_Window::show_mixer_tab()
 {
-	static int global_vol = 100;
+	int global_vol = Audio_Manager::get().get_volume() * 100.0 + 0.5;
 	static int sn_vol = 100;
 	static int ym_vol = 100;
-	ImGui::SliderInt("Global volume", &global_vol, 0, 100);
+	if(ImGui::SliderInt("Global volume", &global_vol, 0, 100))
+		Audio_Manager::get().set_volume(global_vol / 100.0);
 	ImGui::Separator();
 	ImGui::SliderInt("SN76489", &sn_vol, 0, 100);
 	ImGui::SliderInt("YM2612", &ym_vol, 0, 100);
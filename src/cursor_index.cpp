@@ -0,0 +1,269 @@
+#include "cursor_index.h"
+#include "length_table.h"
+
+#include <algorithm>
+#include <climits>
+
+//! Generate cursor indexes for all tracks in a song.
+/*!
+ *  \param lengths Length table for the same song. It must outlive the index.
+ */
+Cursor_Index::Cursor_Index(Song& song, const Length_Table& lengths)
+	: lengths(lengths)
+{
+	for(auto it = song.get_track_map().begin(); it != song.get_track_map().end(); it++)
+	{
+		Track_Index& index = tracks[it->first];
+		index.track = &it->second;
+		index.indexed = build(index, it->first, lengths);
+		if(!index.indexed)
+		{
+			index.ref_position.clear();
+			index.ref_key.clear();
+			index.ref_play_time.clear();
+			index.stops.clear();
+			index.anchors.clear();
+		}
+	}
+}
+
+//! Find the event adjacent to the cursor in a track.
+/*!
+ *  This gives the same result as scan().
+ *
+ *  \param position Track position at the end of the line, from the Line_Map.
+ */
+Cursor_Index::Result Cursor_Index::find(unsigned int track_id, unsigned int position, int line, int column) const
+{
+	Result result = {nullptr, UINT_MAX, UINT_MAX};
+
+	auto it = tracks.find(track_id);
+	if(it == tracks.end())
+		return result;
+
+	const Track_Index& index = it->second;
+	if(!index.indexed)
+		return scan(*index.track, track_id, lengths, position, line, column);
+
+	unsigned int event_count = index.track->get_event_count();
+	if(event_count == 0)
+		return result;
+
+	// Last event before the cursor. Since references are sorted, this is
+	// the last event that is both before the cursor and before the line end.
+	Key cursor = {line, column};
+	auto ref_count = std::min(
+		std::lower_bound(index.ref_key.begin(), index.ref_key.end(), cursor, key_less) - index.ref_key.begin(),
+		std::lower_bound(index.ref_position.begin(), index.ref_position.end(), position) - index.ref_position.begin());
+	unsigned int next = (ref_count > 0) ? index.ref_position[ref_count - 1] + 1 : 0;
+
+	// Adjacent note / rest / tie event right of the cursor
+	unsigned int stop_position = event_count;
+	auto stop = std::lower_bound(index.stops.begin(), index.stops.end(), next,
+		[](const Stop& s, unsigned int pos) { return s.position < pos; });
+	if(stop != index.stops.end())
+	{
+		stop_position = stop->position;
+		if(stop->is_note)
+		{
+			result.reference = stop->reference;
+			result.cursor_time = stop->play_time;
+		}
+	}
+
+	// Nothing was found, select the adjacent event left of cursor.
+	if(result.reference == nullptr)
+	{
+		auto anchor = std::lower_bound(index.anchors.begin(), index.anchors.end(), stop_position,
+			[](const Anchor& a, unsigned int pos) { return a.position < pos; });
+		if(anchor != index.anchors.begin())
+		{
+			--anchor;
+			result.reference = anchor->reference;
+			result.cursor_time = anchor->end_time;
+		}
+	}
+
+	// First event at the line. These are the events between the last event
+	// of the previous lines and the stop position.
+	Key line_start = {line, INT_MIN};
+	auto before_stop = std::lower_bound(index.ref_position.begin(), index.ref_position.end(), stop_position) - index.ref_position.begin();
+	auto before_line = std::min(before_stop,
+		std::lower_bound(index.ref_key.begin(), index.ref_key.end(), line_start, key_less) - index.ref_key.begin());
+	if(before_line < before_stop)
+		result.line_time = index.ref_play_time[before_line];
+
+	if(result.cursor_time < result.line_time)
+		result.line_time = result.cursor_time;
+
+	return result;
+}
+
+//! Check if a track can be looked up using the index.
+/*!
+ *  \return false if the track does not exist or if it falls back to scanning.
+ */
+bool Cursor_Index::is_indexed(unsigned int track_id) const
+{
+	auto it = tracks.find(track_id);
+	return it != tracks.end() && it->second.indexed;
+}
+
+//! Find the event adjacent to the cursor by scanning the track events.
+/*!
+ *  Backtracks from the end of the line until an event before the cursor is
+ *  found, then selects the note right of the cursor, or if there is none,
+ *  the note left of the cursor.
+ *
+ *  \param position Track position at the end of the line, from the Line_Map.
+ */
+Cursor_Index::Result Cursor_Index::scan(Track& track, unsigned int track_id, const Length_Table& lengths, unsigned int position, int line, int column)
+{
+	Result result = {nullptr, UINT_MAX, UINT_MAX};
+	unsigned int event_count = track.get_event_count();
+
+	if(event_count == 0)
+		return result;
+
+	// Backtrack until we find an event adjacent to the cursor
+	while(position-- > 0)
+	{
+		auto ref = track.get_event(position).reference;
+		if(ref != nullptr)
+		{
+			int ref_line = ref->get_line(), ref_column = ref->get_column();
+			if((ref_line < line) || (ref_line == line && ref_column < column))
+				break;
+		}
+	}
+
+	// Select the adjacent note / rest / tie event right of the cursor
+	while(++position < event_count)
+	{
+		auto event = track.get_event(position);
+
+		if(is_note_or_jump(event.type))
+		{
+			result.reference = event.reference.get();
+			if(event.play_time < result.cursor_time)
+				result.cursor_time = event.play_time;
+			break;
+		}
+		else if(is_loop_event(event.type))
+		{
+			break;
+		}
+	}
+
+	// Nothing was found, select the adjacent event left of cursor.
+	// Also scan for the first event at the line.
+	bool passed_line = false;
+	while((!passed_line || result.reference == nullptr) && position-- > 0)
+	{
+		auto event = track.get_event(position);
+		uint32_t length = event.on_time + event.off_time;
+		InputRef* loop_refptr = nullptr;
+
+		if(event.type == Event::JUMP)
+		{
+			length = lengths.get_subroutine_length(event.param);
+		}
+		else if(event.type == Event::LOOP_END)
+		{
+			auto loop = lengths.get_loop(track_id, position);
+			length = loop.length;
+			loop_refptr = loop.reference;
+		}
+
+		auto ref = event.reference;
+		if(ref != nullptr)
+		{
+			passed_line = ((signed)ref->get_line() < line);
+			if(!passed_line && event.play_time < result.line_time)
+				result.line_time = event.play_time;
+		}
+
+		if(result.reference == nullptr && length != 0 && is_note_or_jump(event.type))
+		{
+			result.reference = event.reference.get();
+			if((event.play_time + length) < result.cursor_time)
+				result.cursor_time = event.play_time + length;
+		}
+		else if(result.reference == nullptr && length != 0 && event.type == Event::LOOP_END)
+		{
+			result.reference = loop_refptr;
+			if((event.play_time + length) < result.cursor_time)
+				result.cursor_time = event.play_time + length;
+		}
+	}
+
+	if(result.cursor_time < result.line_time)
+		result.line_time = result.cursor_time;
+
+	return result;
+}
+
+bool Cursor_Index::key_less(const Key& a, const Key& b)
+{
+	return (a.line < b.line) || (a.line == b.line && a.column < b.column);
+}
+
+//! Build the index for a track.
+/*!
+ *  \return false if the track must be scanned instead. This is the case if
+ *          the references are not sorted by input position, the play time
+ *          is not increasing, or a note or loop that could be selected
+ *          has no reference.
+ */
+bool Cursor_Index::build(Track_Index& index, unsigned int track_id, const Length_Table& lengths)
+{
+	Track& track = *index.track;
+	unsigned int event_count = track.get_event_count();
+
+	for(unsigned int position = 0; position < event_count; position++)
+	{
+		auto event = track.get_event(position);
+
+		if(event.reference != nullptr)
+		{
+			Key key = {(int)event.reference->get_line(), (int)event.reference->get_column()};
+			if(index.ref_key.size())
+			{
+				if(key_less(key, index.ref_key.back()) || event.play_time < index.ref_play_time.back())
+					return false;
+			}
+			index.ref_position.push_back(position);
+			index.ref_key.push_back(key);
+			index.ref_play_time.push_back(event.play_time);
+		}
+
+		if(is_note_or_jump(event.type))
+		{
+			if(event.reference == nullptr)
+				return false;
+
+			unsigned int length = event.on_time + event.off_time;
+			if(event.type == Event::JUMP)
+				length = lengths.get_subroutine_length(event.param);
+
+			index.stops.push_back({position, true, event.reference.get(), (unsigned int)event.play_time});
+			if(length != 0)
+				index.anchors.push_back({position, event.reference.get(), event.play_time + length});
+		}
+		else if(is_loop_event(event.type))
+		{
+			index.stops.push_back({position, false, nullptr, (unsigned int)event.play_time});
+			if(event.type == Event::LOOP_END)
+			{
+				auto loop = lengths.get_loop(track_id, position);
+				if(loop.length != 0)
+				{
+					if(loop.reference == nullptr)
+						return false;
+					index.anchors.push_back({position, loop.reference, event.play_time + loop.length});
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+#ifndef CURSOR_INDEX_H
+#define CURSOR_INDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "song.h"
+#include "track.h"
+#include "input.h"
+
+class Length_Table;
+
+//! Index from editor (line, column) positions to track events.
+/*!
+ *  This is generated once per compile. For each track it keeps the
+ *  events with an input reference sorted by (line, column), the events
+ *  that stop the cursor search and the events that can be selected
+ *  when searching to the left of the cursor. The editor cursor mapping
+ *  is then a few binary searches per track instead of a walk over the
+ *  track events.
+ *
+ *  Tracks where the references are not in input order (or some other
+ *  assumption of the index does not hold) fall back to scanning the
+ *  track events.
+ */
+class Cursor_Index
+{
+	public:
+		//! Cursor position in a single track.
+		struct Result
+		{
+			InputRef* reference;		// event adjacent to the cursor, may be nullptr
+			unsigned int cursor_time;	// play time at the cursor, UINT_MAX if not found
+			unsigned int line_time;		// play time at the start of the line, UINT_MAX if not found
+		};
+
+		Cursor_Index(Song& song, const Length_Table& lengths);
+
+		Result find(unsigned int track_id, unsigned int position, int line, int column) const;
+		bool is_indexed(unsigned int track_id) const;
+
+		static Result scan(Track& track, unsigned int track_id, const Length_Table& lengths, unsigned int position, int line, int column);
+
+	private:
+		struct Key
+		{
+			int line;
+			int column;
+		};
+
+		struct Stop
+		{
+			unsigned int position;
+			bool is_note;				// note or subroutine call, otherwise a loop event
+			InputRef* reference;
+			unsigned int play_time;
+		};
+
+		struct Anchor
+		{
+			unsigned int position;
+			InputRef* reference;
+			unsigned int end_time;
+		};
+
+		struct Track_Index
+		{
+			Track* track;
+			bool indexed;
+			// Events with a reference, sorted by position and (line, column).
+			std::vector<unsigned int> ref_position;
+			std::vector<Key> ref_key;
+			std::vector<unsigned int> ref_play_time;
+			// Notes, subroutine calls and loop events, sorted by position.
+			std::vector<Stop> stops;
+			// Notes, subroutine calls and loops with a length, sorted by position.
+			std::vector<Anchor> anchors;
+		};
+
+		static bool key_less(const Key& a, const Key& b);
+		static bool build(Track_Index& index, unsigned int track_id, const Length_Table& lengths);
+
+		const Length_Table& lengths;
+		std::unordered_map<unsigned int, Track_Index> tracks;
+};
+
+#endif
@@ -23,6 +23,8 @@
 #include "track_list_window.h"
 
 #include "dmf_importer.h"
+#include "source_text.h"
+#include "thread_pool.h"
 
 #include "imgui.h"
 
@@ -62,13 +64,11 @@ void Editor_Window::display()
 {
 	bool keep_open = true;
 
+	// A new compile request supersedes any compile that is still in progress.
 	if(test_flag(RECOMPILE))
 	{
-		if(!song_manager->get_compile_in_progress())
-		{
-			if(!song_manager->compile(editor.GetText(), filename))
-				clear_flag(RECOMPILE);
-		}
+		if(!song_manager->compile(std::make_shared<const Source_Text>(editor.GetText()), filename))
+			clear_flag(RECOMPILE);
 	}
 
 	std::string window_id;
@@ -610,6 +610,7 @@ std::string Editor_Window::get_export_filename() const
 void Editor_Window::show_player_controls()
 {
 	auto result = song_manager->get_compile_result();
+	auto snapshot = song_manager->get_snapshot();
 
 	ImGui::SameLine();
 	float content = ImGui::GetContentRegionMax().x;
@@ -642,7 +643,7 @@ void Editor_Window::show_player_controls()
 				ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 1.0f);
 				ImGui::BeginTooltip();
 				ImGui::PushTextWrapPos(ImGui::GetFontSize() * 35.0f);
-				ImGui::TextUnformatted(song_manager->get_error_message().c_str());
+				ImGui::TextUnformatted(snapshot->error_message.c_str());
 				ImGui::PopTextWrapPos();
 				ImGui::EndTooltip();
 				ImGui::PopStyleVar();
@@ -699,19 +700,40 @@ std::string Editor_Window::dump_state()
 {
 	std::string str = "filename: " + filename + "\n";
 	str += "modified: " + std::to_string(test_flag(MODIFIED)) + "\n";
+	auto snapshot = song_manager->get_snapshot();
+	if(snapshot != nullptr)
+	{
+		str += "compile generation: " + std::to_string(snapshot->generation) + "\n";
+		str += "compile latency: " + std::to_string(snapshot->compile_latency) + " us\n";
+		str += "track info time: " + std::to_string(snapshot->track_info_time) + " us ("
+			+ std::to_string(Thread_Pool::get().get_thread_count()) + " threads)\n";
+		str += "first changed line: " + std::to_string(snapshot->first_changed_line) + "\n";
+		if(snapshot->lines != nullptr)
+			str += "line map: " + std::to_string(snapshot->lines->get_line_count()) + " lines, "
+				+ std::to_string(snapshot->lines->get_position_count()) + " track positions, "
+				+ std::to_string(snapshot->lines->get_memory_usage()) + " bytes\n";
+	}
+	auto stats = song_manager->get_compile_stats();
+	str += "compile jobs: " + std::to_string(stats.submitted) + " submitted, "
+		+ std::to_string(stats.superseded) + " superseded, "
+		+ std::to_string(stats.cancelled) + " cancelled, "
+		+ std::to_string(stats.completed) + " completed\n";
+	auto& cache_stats = song_manager->get_editor_cache_stats();
+	str += "editor position cache: " + std::to_string(cache_stats.hits) + " hits, "
+		+ std::to_string(cache_stats.misses) + " misses\n";
 	str += "contents:\n" + editor.GetText() + "\nend contents\n";
 	return str;
 }
 
 void Editor_Window::show_track_positions()
 {
+	static const Song_Manager::Track_Map empty_map = {};
 	std::map<int, std::unordered_set<int>> highlights = {};
-	Song_Manager::Track_Map map = {};
 	unsigned int ticks = 0;
 
-	auto tracks = song_manager->get_tracks();
-	if(tracks != nullptr)
-		map = *tracks;
+	auto snapshot = song_manager->get_snapshot();
+	auto tracks = (snapshot != nullptr) ? snapshot->tracks : nullptr;
+	const Song_Manager::Track_Map& map = (tracks != nullptr) ? *tracks : empty_map;
 
 	auto player = song_manager->get_player();
 	if(player != nullptr && !player->get_finished())
@@ -720,20 +742,14 @@ void Editor_Window::show_track_positions()
 	for(auto track_it = map.begin(); track_it != map.end(); track_it++)
 	{
 		auto& info = track_it->second;
-		int offset = 0;
-
-		// calculate offset to first loop
-		if(ticks > info.length && info.loop_length)
-			offset = ((ticks - info.loop_start) / info.loop_length) * info.loop_length;
 
-		// calculate position
-		auto it = info.events.lower_bound(ticks - offset);
-		if(it != info.events.begin())
+		// find the last event that started before the current position
+		Track_Info::Span span;
+		if(info.events_in_range((int)ticks - 1, ticks, &span, 1))
 		{
-			--it;
-			auto event = it->second;
-			for(auto && i : event.references)
+			for(auto id : info.events.get_references(span.first))
 			{
+				auto i = snapshot->references->get(id);
 				if(!i->get_filename().size())
 				{
 					highlights[i->get_line()].insert(i->get_column());
@@ -17,14 +17,20 @@
 #endif
 
 #include <cstdlib>
+#include <cstring>
+#include <climits>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
 
 #define DEBUG_PRINT(fmt,...)
 
 using std::malloc;
 using std::free;
 
+//! Flag set in a mute_masks slot until the audio thread applies the mask.
+const uint64_t Emu_Player::mute_pending = 1ull << 32;
+
 Device_Wrapper::Device_Wrapper()
 	: dev_init(false)
 	, resmpl_init(false)
@@ -174,12 +180,23 @@ inline void Device_Wrapper::set_mute_mask(uint32_t mask)
 
 Emu_Player::Emu_Player(std::shared_ptr<Song> song, uint32_t start_position)
 	: sample_rate(1)
-	, delta_time(0)
-	, sample_delta(1)
-	, play_time(0)
-	, play_time2(0)
+	, max_block_size(INT_MAX)
+	, time_streams(false)
+	, step_timer()
+	, render_stats()
+	, streams()
+	, active_streams()
+	, active_stream_count(0)
+	, error_flag(false)
+	, error_text()
+	, stop_flag(false)
+	, loop_count(0)
+	, unknown_poke_count(0)
+	, last_unknown_poke(0)
 	, song(song)
 {
+	for(auto && mask : mute_masks)
+		mask.store(0, std::memory_order_relaxed);
 
 	driver = song->get_platform()->get_driver(1, (VGM_Interface*)this);
 	driver.get()->play_song(*song.get());
@@ -196,14 +213,65 @@ std::shared_ptr<Driver>& Emu_Player::get_driver()
 	return driver;
 }
 
-void Emu_Player::set_mute_mask(const std::map<int16_t,uint32_t>& mask_map)
+//! Limit the number of samples each sound chip renders at once.
+/*!
+ *  1 renders one sample at a time, which is how the chips were rendered
+ *  before block rendering. Used to compare the two in benchmarks.
+ *  0 removes the limit.
+ */
+void Emu_Player::set_max_block_size(int samples)
 {
+	max_block_size = (samples > 0) ? samples : INT_MAX;
+}
+
+//! Measure the time spent updating DAC streams, for benchmarks.
+/*!
+ *  The time is added to Render_Stats::stream_time. This reads the clock
+ *  twice per block, so it should not be enabled for playback.
+ */
+void Emu_Player::set_time_streams(bool enable)
+{
+	time_streams = enable;
+}
+
+//! Set channel mute masks.
+/*!
+ *  The masks are applied by the audio thread at the start of the next
+ *  get_sample() call, so a change takes effect at a buffer boundary and
+ *  not at a sample offset inside the buffer. With the audio device this
+ *  delays the change by up to one buffer.
+ *
+ *  Each chip has one slot holding its latest mask, so a change is never
+ *  dropped, and masks set several times before the audio thread runs are
+ *  only applied once.
+ *
+ *  \return false if a chip id is out of range. Those masks are ignored.
+ */
+bool Emu_Player::set_mute_mask(const std::map<int16_t,uint32_t>& mask_map)
+{
+	bool result = true;
 	for(auto && i : mask_map)
 	{
-		auto dev = devices.find(i.first);
+		if(i.first < 0 || i.first >= max_mute_chips)
+			result = false;
+		else
+			mute_masks[i.first].store(mute_pending | i.second, std::memory_order_release);
+	}
+	return result;
+}
+
+//! Apply queued parameter changes. Called from the audio thread.
+void Emu_Player::update_parameters()
+{
+	for(int chip_id = 0; chip_id < max_mute_chips; chip_id++)
+	{
+		if(!(mute_masks[chip_id].load(std::memory_order_relaxed) & mute_pending))
+			continue;
+		uint64_t mask = mute_masks[chip_id].exchange(0, std::memory_order_acquire);
+		auto dev = devices.find(chip_id);
 		if(dev != devices.end())
 		{
-			dev->second.set_mute_mask(i.second);
+			dev->second.set_mute_mask((uint32_t)mask);
 		}
 	}
 }
@@ -218,9 +286,7 @@ void Emu_Player::setup_stream(uint32_t sample_rate)
 	if(sample_rate == 0)
 		sample_rate = 1;
 	this->sample_rate = sample_rate;
-	sample_delta = 1.0 / sample_rate;
-	delta_time = 0;
-	printf("Emu_Player stream setup %d Hz, delta = %.8f, init = %.8f\n", sample_rate, sample_delta, delta_time);
+	step_timer.set_sample_rate(sample_rate);
 
 	for(auto it = devices.begin(); it != devices.end(); it++)
 	{
@@ -228,59 +294,54 @@ void Emu_Player::setup_stream(uint32_t sample_rate)
 	}
 }
 
+//! Render samples.
+/*!
+ *  The driver and DAC streams are updated at the start of each sample,
+ *  as before. Between register writes, the sound chips are rendered in
+ *  blocks, so that the resampler is not run one sample at a time.
+ *  A block ends at the sample where the next driver step or DAC stream
+ *  write occurs.
+ *
+ *  Driver steps are scheduled by a Step_Timer, so the step timing is
+ *  exact at any sample rate.
+ *
+ *  Queued mute changes are applied before the first sample.
+ */
 int Emu_Player::get_sample(WAVE_32BS* output, int count, int channels)
 {
+	update_parameters();
 	try
 	{
-		for(int i = 0; i < count; i++)
+		int i = 0;
+		while(i < count)
 		{
-			int max_steps = 100;
-			delta_time += sample_delta;
-			play_time += sample_delta;
-
-			if(delta_time > 0)
+			// Run the driver and DAC streams for the first sample of the block
+			step_timer.advance(1);
+			while(step_timer.step_due())
 			{
-				//printf("\n%.8f,%.8f=%.8f ", play_time, play_time-play_time2, delta_time);
-				play_time2 = play_time;
-			}
-
-			while(delta_time > 0)
-			{
-				double step = driver.get()->play_step();
-				delta_time -= step;
-
-				//printf("-%.8f, ", step);
-				if(!--max_steps)
-					break;
+				step_timer.add_step(driver.get()->play_step());
+				render_stats.driver_steps++;
 			}
 
-			// Update any dac streams
-			for(auto && it = streams.begin(); it != streams.end(); it++)
-			{
-				if(it->second.active)
-				{
-					it->second.counter += it->second.freq;
-					while(it->second.counter >= sample_rate)
-					{
-						devices[it->second.chip_id].write(
-								it->second.port,
-								it->second.reg,
-								datablocks[it->second.db_id][it->second.position]);
-						it->second.position ++;
-						it->second.counter -= sample_rate;
-						if(!--it->second.length)
-						{
-							it->second.active = false;
-						}
-					}
-				}
-			}
-
-			// Get sample from sound chips
+			// Skip ahead to the next driver step or stream write
+			std::chrono::steady_clock::time_point stream_start;
+			if(time_streams)
+				stream_start = std::chrono::steady_clock::now();
+			int block_size = 1 + update_streams(std::min(count - i, max_block_size) - 1);
+			if(time_streams)
+				render_stats.stream_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - stream_start).count();
+			block_size = 1 + step_timer.get_idle_samples(block_size - 1);
+			step_timer.advance(block_size - 1);
+			skip_streams(block_size - 1);
+
+			// Get samples from sound chips
 			for(auto && it = devices.begin(); it != devices.end(); it++)
 			{
-				it->second.get_sample(&output[i], 1);
+				it->second.get_sample(&output[i], block_size);
 			}
+			i += block_size;
+			render_stats.samples += block_size;
+			render_stats.blocks++;
 
 			if(!driver.get()->is_playing())
 				set_finished(true);
@@ -297,15 +358,139 @@ int Emu_Player::get_sample(WAVE_32BS* output, int count, int channels)
 	return count;
 }
 
+//! Update DAC streams for one sample.
+/*!
+ *  \param max_samples Maximum number of samples to look ahead.
+ *  \return the number of following samples (up to \p max_samples) where no
+ *          stream writes occur.
+ */
+int Emu_Player::update_streams(int max_samples)
+{
+	int idle_samples = max_samples;
+	for(int i = 0; i < active_stream_count; i++)
+	{
+		Stream& stream = streams[active_streams[i]];
+		stream.counter += stream.freq;
+		if(stream.counter >= sample_rate)
+		{
+			// Write all bytes due in this sample
+			uint32_t writes = stream.counter / sample_rate;
+			writes = std::min(writes, stream.length);
+			writes = std::min(writes, stream.data_size - std::min(stream.position, stream.data_size));
+			const uint8_t* data = stream.data + stream.position;
+			for(uint32_t j = 0; j < writes; j++)
+				stream.device->write(stream.port, stream.reg, data[j]);
+			stream.position += writes;
+			render_stats.dac_writes += writes;
+			stream.length -= writes;
+			stream.counter -= writes * sample_rate;
+			if(!stream.length || stream.counter >= sample_rate)
+			{
+				// End of stream or data
+				set_stream_active(active_streams[i--], false);
+				continue;
+			}
+		}
+		// samples until the counter reaches the sample rate again
+		if(stream.freq)
+			idle_samples = std::min<int>(idle_samples, (sample_rate - 1 - stream.counter) / stream.freq);
+	}
+	return idle_samples;
+}
+
+//! Advance DAC streams by a number of samples where no writes occur.
+void Emu_Player::skip_streams(int samples)
+{
+	if(!samples)
+		return;
+	for(int i = 0; i < active_stream_count; i++)
+	{
+		Stream& stream = streams[active_streams[i]];
+		stream.counter += stream.freq * samples;
+	}
+}
+
+//! Add or remove a stream from the active stream list.
+void Emu_Player::set_stream_active(uint8_t sid, bool active)
+{
+	Stream& stream = streams[sid];
+	if(stream.active == active)
+		return;
+	stream.active = active;
+	if(active)
+	{
+		active_streams[active_stream_count++] = sid;
+	}
+	else
+	{
+		// Move the last active stream into the gap
+		for(int i = 0; i < active_stream_count; i++)
+		{
+			if(active_streams[i] == sid)
+			{
+				active_streams[i] = active_streams[--active_stream_count];
+				break;
+			}
+		}
+	}
+}
+
+//! Look up the datablock of a stream.
+void Emu_Player::resolve_stream_data(Stream& stream)
+{
+	auto it = datablocks.find(stream.db_id);
+	if(it != datablocks.end())
+	{
+		stream.data = it->second.data();
+		stream.data_size = it->second.size();
+	}
+	else
+	{
+		stream.data = nullptr;
+		stream.data_size = 0;
+	}
+}
+
 void Emu_Player::stop_stream()
 {
-	printf("Emu_Player stream stop\n");
 }
 
+//! Print the events recorded during playback.
+void Emu_Player::log_events()
+{
+	if(loop_count.load(std::memory_order_relaxed))
+		printf("Emu_Player set loop (%d times)\n", loop_count.load(std::memory_order_relaxed));
+	if(stop_flag.load(std::memory_order_relaxed))
+		printf("Emu_Player stop\n");
+	if(unknown_poke_count.load(std::memory_order_relaxed))
+		printf("Emu_Player ignored %d writes to unknown offsets (last %02x)\n",
+			unknown_poke_count.load(std::memory_order_relaxed), last_unknown_poke.load(std::memory_order_relaxed));
+	if(error_flag.load(std::memory_order_acquire))
+		printf("Playback error: %s\n", error_text.data());
+}
+
+//! Get the playback error, or an empty string if no error occurred.
+std::string Emu_Player::get_error_message() const
+{
+	if(error_flag.load(std::memory_order_acquire))
+		return error_text.data();
+	return "";
+}
+
+//! Stop playback after an error.
+/*!
+ *  Called from the audio thread, so the message is only stored here.
+ *  It is printed by log_events(). Only the first error is kept.
+ */
 void Emu_Player::handle_error(const char* str)
 {
-	printf("Playback error: %s\n", str);
-	delta_time = -1000; // Prevent error from reoccuring
+	if(!error_flag.load(std::memory_order_relaxed))
+	{
+		std::strncpy(error_text.data(), str, error_text.size() - 1);
+		error_text.back() = 0;
+		error_flag.store(true, std::memory_order_release);
+	}
+	step_timer.add_step(1000.0); // Prevent error from reoccuring
 	set_finished(true);
 }
 
@@ -331,27 +516,31 @@ void Emu_Player::write(uint8_t command, uint16_t port, uint16_t reg, uint16_t da
 void Emu_Player::dac_setup(uint8_t sid, uint8_t chip_id, uint32_t port, uint32_t reg, uint8_t db_id)
 {
 	//printf("Emu_Player setup stream %02x = %02x,%02x,%02x,%02x\n", sid, chip_id, port, reg, db_id);
-	streams[sid].chip_id = chip_id;
+	set_stream_active(sid, false);
+	auto device = devices.find(chip_id);
+	streams[sid].device = (device != devices.end()) ? &device->second : nullptr;
 	streams[sid].port = port;
 	streams[sid].reg = reg;
 	streams[sid].db_id = db_id;
-	streams[sid].active = false;
 }
 
 void Emu_Player::dac_start(uint8_t sid, uint32_t start, uint32_t length, uint32_t freq)
 {
 	//printf("Emu_Player start stream %02x = %d,%d,%d\n", sid, start,length,freq);
+	if(streams[sid].device == nullptr)
+		return;
+	resolve_stream_data(streams[sid]);
 	streams[sid].position = start;
 	streams[sid].length = length;
 	streams[sid].freq = freq;
 	streams[sid].counter = sample_rate;
-	streams[sid].active = true;
+	set_stream_active(sid, true);
 }
 
 void Emu_Player::dac_stop(uint8_t sid)
 {
 	//printf("Emu_Player stop stream %02x\n", sid);
-	streams[sid].active = false;
+	set_stream_active(sid, false);
 }
 
 //! Initialize sound chip.
@@ -370,29 +559,40 @@ void Emu_Player::poke32(uint32_t offset, uint32_t data)
 			devices[DEVID_YM2612].init_ym2612(clock);
 			break;
 		default:
-			printf("Emu_Player poke %02x = %08x\n", offset, data);
+			ignore_poke(offset);
 			break;
 	}
 }
 
 void Emu_Player::poke16(uint32_t offset, uint16_t data)
 {
-	printf("Emu_Player poke %02x = %04x\n", offset, data);
+	ignore_poke(offset);
 }
 
 void Emu_Player::poke8(uint32_t offset, uint8_t data)
 {
-	printf("Emu_Player poke %02x = %02x\n", offset, data);
+	ignore_poke(offset);
+}
+
+//! Count a write to an unsupported offset.
+/*!
+ *  Called from the audio thread, so the write is only counted here.
+ *  It is printed by log_events().
+ */
+void Emu_Player::ignore_poke(uint32_t offset)
+{
+	last_unknown_poke.store(offset, std::memory_order_relaxed);
+	unknown_poke_count.fetch_add(1, std::memory_order_relaxed);
 }
 
 void Emu_Player::set_loop()
 {
-	printf("Emu_Player set loop\n");
+	loop_count.fetch_add(1, std::memory_order_relaxed);
 }
 
 void Emu_Player::stop()
 {
-	printf("Emu_Player stop\n");
+	stop_flag.store(true, std::memory_order_relaxed);
 	set_finished(true);
 }
 
@@ -406,4 +606,11 @@ void Emu_Player::datablock(uint8_t dbtype, uint32_t dbsize, const uint8_t* db, u
 #endif
 	datablocks[dbtype].resize(maxsize);
 	std::copy_n(db, dbsize, datablocks[dbtype].begin() + offset);
+
+	// The datablock may have moved
+	for(auto && stream : streams)
+	{
+		if(stream.db_id == dbtype && stream.data != nullptr)
+			resolve_stream_data(stream);
+	}
 }
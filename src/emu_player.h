@@ -4,6 +4,9 @@
 #include <memory>
 #include <map>
 #include <vector>
+#include <array>
+#include <atomic>
+#include <string>
 
 #if defined(LOCAL_LIBVGM)
 #include "emu/EmuStructs.h"
@@ -16,6 +19,8 @@
 #endif
 
 #include "audio_manager.h"
+#include "audio_stream.h"
+#include "step_timer.h"
 #include "vgm.h"
 #include "driver.h"
 
@@ -65,19 +70,42 @@ class Emu_Player
 	, public Audio_Stream
 {
 	public:
+		//! Counters for the rendered audio, used by benchmarks.
+		struct Render_Stats
+		{
+			uint64_t samples;
+			uint64_t blocks;			// sound chip render calls per chip
+			uint64_t driver_steps;
+			uint64_t dac_writes;
+			double stream_time;			// seconds spent in DAC stream updates, if enabled
+		};
+
 		Emu_Player(std::shared_ptr<Song> song, uint32_t start_position = 0);
 		virtual ~Emu_Player();
 
 		std::shared_ptr<Driver>& get_driver();
 
-		void set_mute_mask(const std::map<int16_t,uint32_t>& mask_map);
+		bool set_mute_mask(const std::map<int16_t,uint32_t>& mask_map);
 
 		void setup_stream(uint32_t sample_rate);
 		int get_sample(WAVE_32BS* output, int count, int channels);
 		void stop_stream();
+		void log_events();
+
+		std::string get_error_message() const;
+
+		void set_max_block_size(int samples);
+		void set_time_streams(bool enable);
+
+		//! Get the counters for the audio rendered so far.
+		inline const Render_Stats& get_render_stats() const { return render_stats; }
 
 	private:
 		void handle_error(const char* str);
+		void ignore_poke(uint32_t offset);
+		void update_parameters();
+		int update_streams(int max_samples);
+		void skip_streams(int samples);
 		void write(uint8_t command, uint16_t port, uint16_t reg, uint16_t data);
 		void dac_setup(uint8_t sid, uint8_t chip_id, uint32_t port, uint32_t reg, uint8_t db_id);
 		void dac_start(uint8_t sid, uint32_t start, uint32_t length, uint32_t freq);
@@ -96,9 +124,12 @@ class Emu_Player
 			uint32_t flags = 0,
 			uint32_t offset = 0);
 
+		//! DAC stream. Device and data pointers are resolved when the stream is set up and started.
 		struct Stream
 		{
-			uint8_t chip_id;
+			Device_Wrapper* device;
+			const uint8_t* data;
+			uint32_t data_size;
 			uint8_t port;
 			uint8_t reg;
 			uint8_t db_id;
@@ -109,15 +140,36 @@ class Emu_Player
 			int32_t counter;
 		};
 
+		const static int max_streams = 256; // VGM stream ids are 8 bit
+		const static int max_mute_chips = 64; // libvgm device ids
+		const static uint64_t mute_pending;
+
+		void resolve_stream_data(Stream& stream);
+		void set_stream_active(uint8_t sid, bool active);
+
 		int sample_rate;
-		float delta_time;
-		float sample_delta;
-		float play_time;
-		float play_time2;
+		int max_block_size;
+		bool time_streams;
+		Step_Timer step_timer;
+		Render_Stats render_stats;
 
 		std::map<int, Device_Wrapper> devices;
 		std::map<int, std::vector<uint8_t>> datablocks;
-		std::map<int, Stream> streams;
+		std::array<Stream, max_streams> streams;		// indexed by stream id
+		std::array<uint8_t, max_streams> active_streams;	// ids of active streams
+		int active_stream_count;
+
+		// Latest mute mask for each chip id, passed to the audio thread.
+		// mute_pending is set while the mask has not been applied.
+		std::array<std::atomic<uint64_t>, max_mute_chips> mute_masks;
+
+		// Events recorded by the audio thread, printed later by log_events()
+		std::atomic<bool> error_flag;
+		std::array<char, 256> error_text;		// written once, before error_flag is set
+		std::atomic<bool> stop_flag;
+		std::atomic<unsigned int> loop_count;
+		std::atomic<unsigned int> unknown_poke_count;
+		std::atomic<uint32_t> last_unknown_poke;
 
 		std::shared_ptr<Driver> driver;
 		std::shared_ptr<Song> song;
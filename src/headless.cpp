@@ -0,0 +1,160 @@
+#include "headless.h"
+#include "source_text.h"
+#include "offline_renderer.h"
+#include "thread_pool.h"
+
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+//! Seconds to wait for a compile result before giving up.
+static const double compile_timeout = 300;
+
+//! Read a file into a string.
+bool read_file(const char* filename, std::string& str)
+{
+	auto file = std::ifstream(filename);
+	if(!file.good())
+	{
+		fprintf(stderr, "Cannot open file '%s'\n", filename);
+		return false;
+	}
+	str.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+//! Compile and wait until the result and all Track_Info is available.
+/*!
+ *  \return the compile result, or nullptr if there was no result after
+ *          compile_timeout seconds. An error is printed in this case.
+ */
+std::shared_ptr<const Song_Manager::Compile_Snapshot> compile_and_wait(Song_Manager& song_manager,
+	std::shared_ptr<const Source_Text> text, const std::string& filename)
+{
+	auto start_time = std::chrono::steady_clock::now();
+	song_manager.compile(text, filename);
+	std::shared_ptr<const Song_Manager::Compile_Snapshot> snapshot;
+	while(1)
+	{
+		snapshot = song_manager.get_snapshot();
+		if(song_manager.get_compile_result() != Song_Manager::COMPILE_NOT_DONE && snapshot->tracks_complete)
+			return snapshot;
+		if(std::chrono::steady_clock::now() - start_time > std::chrono::duration<double>(compile_timeout))
+		{
+			fprintf(stderr, "%s: no compile result after %.0f s\n", filename.c_str(), compile_timeout);
+			return nullptr;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+//! Read and compile an MML file.
+/*!
+ *  \return the compile result, or nullptr if the file could not be read or
+ *          compiled. An error is printed in this case.
+ */
+std::shared_ptr<const Song_Manager::Compile_Snapshot> load_song(Song_Manager& song_manager, const char* filename)
+{
+	std::string str;
+	if(!read_file(filename, str))
+		return nullptr;
+
+	auto snapshot = compile_and_wait(song_manager, std::make_shared<const Source_Text>(std::move(str)), filename);
+	if(snapshot && !snapshot->successful)
+	{
+		fprintf(stderr, "%s\n", snapshot->error_message.c_str());
+		return nullptr;
+	}
+	return snapshot;
+}
+
+//! Get the file name of a stem. "song.wav" becomes "song_A.wav" for track A.
+std::string get_stem_filename(const std::string& output, int track_id)
+{
+	std::string name = output;
+	std::string extension = ".wav";
+	if(name.size() >= extension.size() && !name.compare(name.size() - extension.size(), extension.size(), extension))
+		name.erase(name.size() - extension.size());
+	name += "_";
+	if(track_id <= 'Z'-'A')
+		name.push_back(track_id + 'A');
+	else
+		name += std::to_string(track_id);
+	return name + extension;
+}
+
+//! Compile an MML file and render it to WAV files without opening a window.
+/*!
+ *  If stems is set, each track with a channel is rendered to its own file
+ *  with only that channel audible. The stems are rendered in parallel.
+ */
+int render_file(const char* input, const char* output, uint32_t sample_rate, double length, bool stems,
+	Sample_Converter::Format format, unsigned int channels)
+{
+	Song_Manager song_manager;
+	auto snapshot = load_song(song_manager, input);
+	if(!snapshot)
+		return 1;
+
+	if(length <= 0)
+		length = Offline_Renderer::get_song_length(*snapshot->tracks, *snapshot->tempo_map);
+
+	// One renderer for the song, or one per stem
+	std::vector<Offline_Renderer> renderers;
+	std::vector<std::string> filenames;
+	try
+	{
+		if(stems)
+		{
+			for(auto && i : *snapshot->tracks)
+			{
+				auto mask = song_manager.get_solo_mask(i.first);
+				if(mask.empty())
+					continue;
+				renderers.emplace_back(snapshot->song, sample_rate);
+				renderers.back().set_mute_mask(mask);
+				filenames.push_back(get_stem_filename(output, i.first));
+			}
+		}
+		else
+		{
+			renderers.emplace_back(snapshot->song, sample_rate);
+			filenames.push_back(output);
+		}
+	}
+	catch(std::exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	auto start_time = std::chrono::steady_clock::now();
+	Thread_Pool::get().run(renderers.size(), [&](unsigned int i)
+	{
+		renderers[i].set_length(length);
+		renderers[i].set_output_format(format, channels);
+		renderers[i].render(filenames[i]);
+	});
+	double render_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+	int status = 0;
+	double rendered_length = 0;
+	for(unsigned int i = 0; i < renderers.size(); i++)
+	{
+		if(renderers[i].get_error_message().size())
+		{
+			fprintf(stderr, "%s: %s\n", filenames[i].c_str(), renderers[i].get_error_message().c_str());
+			status = 1;
+		}
+		rendered_length += renderers[i].get_rendered_length();
+	}
+	printf("Rendered %d file(s), %.3f s of audio in %.3f s (%.1fx real time, %d threads)\n",
+		(int)renderers.size(),
+		rendered_length,
+		render_time,
+		(render_time > 0) ? rendered_length / render_time : 0,
+		Thread_Pool::get().get_thread_count());
+	return status;
+}
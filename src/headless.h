@@ -0,0 +1,25 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "song_manager.h"
+#include "sample_converter.h"
+
+// Functions for the command line modes that run without a window.
+
+bool read_file(const char* filename, std::string& str);
+
+std::shared_ptr<const Song_Manager::Compile_Snapshot> compile_and_wait(Song_Manager& song_manager,
+	std::shared_ptr<const Source_Text> text, const std::string& filename);
+
+std::shared_ptr<const Song_Manager::Compile_Snapshot> load_song(Song_Manager& song_manager, const char* filename);
+
+std::string get_stem_filename(const std::string& output, int track_id);
+
+int render_file(const char* input, const char* output, uint32_t sample_rate, double length, bool stems,
+	Sample_Converter::Format format, unsigned int channels);
+
+#endif
@@ -0,0 +1,126 @@
+#include "length_table.h"
+
+#include <stdexcept>
+
+// Maximum subroutine/loop nesting depth
+const unsigned int Length_Table::max_recursion = 10;
+
+//! Generate length tables for all tracks in a song.
+Length_Table::Length_Table(Song& song)
+{
+	for(auto it = song.get_track_map().begin(); it != song.get_track_map().end(); it++)
+	{
+		Track& track = it->second;
+		Track_Lengths& lengths = tracks[it->first];
+
+		lengths.subroutine_length = calculate_subroutine_length(song, it->first, max_recursion);
+
+		for(unsigned int position = 0; position < track.get_event_count(); position++)
+		{
+			if(track.get_event(position).type == Event::LOOP_END)
+			{
+				Loop_Info loop;
+				loop.length = calculate_loop_length(song, track, position, loop.reference, max_recursion);
+				lengths.loops[position] = loop;
+			}
+		}
+	}
+}
+
+//! Get the length of a subroutine.
+/*!
+ *  \return zero if the track does not exist.
+ */
+unsigned int Length_Table::get_subroutine_length(unsigned int track_id) const
+{
+	auto it = tracks.find(track_id);
+	if(it != tracks.end())
+		return it->second.subroutine_length;
+	return 0;
+}
+
+//! Get the length of a loop section.
+/*!
+ *  \param position Position of the LOOP_END event.
+ *  \return zero length if there is no loop end at the position.
+ */
+Length_Table::Loop_Info Length_Table::get_loop(unsigned int track_id, unsigned int position) const
+{
+	auto it = tracks.find(track_id);
+	if(it != tracks.end())
+	{
+		auto loop = it->second.loops.find(position);
+		if(loop != it->second.loops.end())
+			return loop->second;
+	}
+	return {0, nullptr};
+}
+
+//! Get the length of a loop section.
+unsigned int Length_Table::calculate_loop_length(Song& song, Track& track, unsigned int position, InputRef*& refptr, unsigned int max_recursion)
+{
+	// This function is a hack only needed in the case where a subroutine ends with a loop section.
+	// Until I properly count the length of subroutines again, this will be necessary.
+	// Example: passport.mml:177
+	int depth = 0;
+	int count = track.get_event(position).param - 1;
+	int start_time = 0;
+	int end_time = track.get_event(position).play_time;
+	int break_time = 0;
+	refptr = nullptr;
+	while(position-- > 0)
+	{
+		auto event = track.get_event(position);
+		start_time = event.play_time;
+		if(is_note_or_jump(event.type) && refptr == nullptr)
+		{
+			refptr = event.reference.get();
+		}
+		else if(event.type == Event::LOOP_END)
+		{
+			if(refptr == nullptr)
+				calculate_loop_length(song, track, position, refptr, max_recursion - 1);
+			depth++;
+		}
+		else if(event.type == Event::LOOP_BREAK && !depth)
+		{
+			break_time = end_time - event.play_time;
+			refptr = nullptr;
+		}
+		else if(event.type == Event::LOOP_START)
+		{
+			if(depth)
+				depth--;
+			else
+				break;
+		}
+	}
+	unsigned int result = (end_time - start_time) * count - break_time;
+	return result;
+}
+
+//! Get the length of a subroutine.
+unsigned int Length_Table::calculate_subroutine_length(Song& song, unsigned int param, unsigned int max_recursion)
+{
+	try
+	{
+		Track& track = song.get_track(param);
+		InputRef* dummy;
+		if(track.get_event_count())
+		{
+			auto event = track.get_event(track.get_event_count() - 1);
+			uint32_t end_time;
+			if(event.type == Event::JUMP && max_recursion != 0)
+				end_time = event.play_time + calculate_subroutine_length(song, event.param, max_recursion - 1);
+			else if(event.type == Event::LOOP_END && max_recursion != 0)
+				end_time = event.play_time + calculate_loop_length(song, track, track.get_event_count() - 1, dummy, max_recursion - 1);
+			else
+				end_time = event.play_time + event.on_time + event.off_time;
+			return end_time - track.get_event(0).play_time;
+		}
+	}
+	catch(std::exception &e)
+	{
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef LENGTH_TABLE_H
+#define LENGTH_TABLE_H
+
+#include <unordered_map>
+
+#include "song.h"
+#include "track.h"
+#include "input.h"
+
+//! Check if event is a note or subroutine call
+inline bool is_note_or_jump(Event::Type type)
+{
+	if(type == Event::NOTE || type == Event::TIE || type == Event::REST || type == Event::JUMP)
+		return true;
+	else
+		return false;
+}
+
+//! Check if event is a loop end
+inline bool is_loop_event(Event::Type type)
+{
+	if(type == Event::LOOP_START || type == Event::LOOP_BREAK || type == Event::LOOP_END)
+		return true;
+	else
+		return false;
+}
+
+//! Precomputed subroutine and loop section lengths for all tracks in a song.
+/*!
+ *  This is generated once per compile, so that the editor cursor mapping
+ *  does not need to walk the tracks to calculate the lengths.
+ */
+class Length_Table
+{
+	public:
+		//! Length of a loop section ending at a LOOP_END event.
+		struct Loop_Info
+		{
+			unsigned int length;
+			InputRef* reference;	// last note or subroutine call in the loop, may be nullptr
+		};
+
+		Length_Table(Song& song);
+
+		unsigned int get_subroutine_length(unsigned int track_id) const;
+		Loop_Info get_loop(unsigned int track_id, unsigned int position) const;
+
+		static unsigned int calculate_loop_length(Song& song, Track& track, unsigned int position, InputRef*& refptr, unsigned int max_recursion);
+		static unsigned int calculate_subroutine_length(Song& song, unsigned int param, unsigned int max_recursion);
+
+	private:
+		const static unsigned int max_recursion;
+
+		struct Track_Lengths
+		{
+			unsigned int subroutine_length;
+			std::unordered_map<unsigned int, Loop_Info> loops; // indexed by event position
+		};
+
+		std::unordered_map<unsigned int, Track_Lengths> tracks;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "line_map.h"
+
+Line_Map::Line_Map()
+	: line_start(1, 0)
+	, positions()
+{
+}
+
+//! Add the track positions at the end of a line.
+/*!
+ *  Lines must be inserted in increasing order. Skipped lines have no
+ *  track positions.
+ */
+void Line_Map::insert(int line, const Track_Position_Map& map)
+{
+	if(line < get_line_count())
+		return;
+
+	line_start.resize(line + 1, positions.size());
+	for(auto && i : map)
+		positions.push_back({i.first, i.second});
+	line_start.push_back(positions.size());
+}
+
+//! Get the track positions at the end of a line.
+/*!
+ *  Only the tracks that appear on the line are included, the same as
+ *  MML_Input::get_track_map() after reading the line.
+ *
+ *  \return an empty map if the line is out of range.
+ */
+Line_Map::Track_Position_Map Line_Map::at(int line) const
+{
+	Track_Position_Map output;
+	if(line < 0 || line >= get_line_count())
+		return output;
+
+	for(uint32_t i = line_start[line]; i < line_start[line + 1]; i++)
+		output.emplace_hint(output.end(), positions[i].track, positions[i].position);
+	return output;
+}
+
+//! Get the approximate memory used by the map, in bytes.
+std::size_t Line_Map::get_memory_usage() const
+{
+	return sizeof(*this)
+		+ line_start.capacity() * sizeof(uint32_t)
+		+ positions.capacity() * sizeof(Track_Position);
+}
@@ -0,0 +1,50 @@
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "mml_input.h"
+
+//! Track positions at each line of the MML input.
+/*!
+ *  For each line, the positions of the tracks that appear on it are stored
+ *  in one flat array, with an index of where each line starts. Memory use
+ *  grows with the number of positions rather than with one map per line,
+ *  and inserting a line does not allocate map nodes.
+ */
+class Line_Map
+{
+	public:
+		typedef MML_Input::Track_Position_Map Track_Position_Map;
+		typedef Track_Position_Map::key_type Track_Id;
+		typedef Track_Position_Map::mapped_type Position;
+
+		Line_Map();
+
+		void insert(int line, const Track_Position_Map& map);
+		Track_Position_Map at(int line) const;
+
+		//! Get the number of lines in the map.
+		inline int get_line_count() const { return line_start.size() - 1; }
+
+		//! Get the number of stored track positions.
+		inline std::size_t get_position_count() const { return positions.size(); }
+
+		std::size_t get_memory_usage() const;
+
+	private:
+		struct Track_Position
+		{
+			Track_Id track;
+			Position position;
+		};
+
+		// positions of line i are positions[line_start[i]] to positions[line_start[i+1]-1]
+		std::vector<uint32_t> line_start;
+		std::vector<Track_Position> positions;
+};
+
+#endif
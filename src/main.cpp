@@ -1,5 +1,8 @@
 #include "main_window.h"
 #include "audio_manager.h"
+#include "thread_pool.h"
+#include "headless.h"
+#include "benchmark.h"
 
 // dear imgui: standalone example application for GLFW + OpenGL 3, using programmable pipeline
 // If you are new to dear imgui, see examples/README.txt and documentation at the top of imgui.cpp.
@@ -102,29 +105,121 @@ static void restyle_with_scale(float scale)
 	ImGui::GetIO().Fonts->AddFontDefault(&font_config);
 }
 
+//! Get the value of a command line option, or NULL if it is missing.
+static const char* get_option_value(int argc, char* argv[], int& carg)
+{
+	if(carg + 1 < argc)
+		return argv[++carg];
+	fprintf(stderr, "Missing value for option '%s'\n", argv[carg]);
+	return nullptr;
+}
+
 int main(int argc, char* argv[])
 {
+	const char* render_input = nullptr;
+	const char* render_output = nullptr;
+	uint32_t render_rate = 44100;
+	double render_length = 0;
+	bool render_stems = false;
+	Sample_Converter::Format output_format = Sample_Converter::S16;
+	unsigned int output_channels = 2;
+	const char* benchmark_name = nullptr;
+	const char* benchmark_input = nullptr;
 	int driver_id = -1;
 	int device_id = -1;
 	float ui_scale = 1.0f;
 	int carg = 1;
 	while(carg < argc)
 	{
-		if(!std::strcmp(argv[carg], "--driver-id") && (argc > carg))
+		const char* option = argv[carg];
+		const char* value = nullptr;
+		if(!std::strcmp(option, "--driver-id"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			driver_id = strtol(value, NULL, 0);
+		}
+		if(!std::strcmp(option, "--device-id"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			device_id = strtol(value, NULL, 0);
+		}
+		if(!std::strcmp(option, "--ui-scale"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			ui_scale = strtof(value, NULL);
+		}
+		if(!std::strcmp(option, "--compile-threads"))
 		{
-			driver_id = strtol(argv[++carg], NULL, 0);
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			Thread_Pool::set_default_thread_count(strtol(value, NULL, 0));
 		}
-		if(!std::strcmp(argv[carg], "--device-id") && (argc > carg))
+		if(!std::strcmp(option, "--track-info-budget"))
 		{
-			device_id = strtol(argv[++carg], NULL, 0);
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			Song_Manager::set_track_info_budget(strtoul(value, NULL, 0));
 		}
-		if(!std::strcmp(argv[carg], "--ui-scale") && (argc > carg))
+		if(!std::strcmp(option, "--render"))
 		{
-			ui_scale = strtof(argv[++carg], NULL);
+			if(!(render_input = get_option_value(argc, argv, carg)))
+				return 1;
+			if(!(render_output = get_option_value(argc, argv, carg)))
+				return 1;
+		}
+		if(!std::strcmp(option, "--stems"))
+		{
+			render_stems = true;
+		}
+		if(!std::strcmp(option, "--sample-format"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			if(!Sample_Converter::find_format(value, output_format))
+			{
+				fprintf(stderr, "Unknown sample format '%s'\n", value);
+				return 1;
+			}
+		}
+		if(!std::strcmp(option, "--channels"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			output_channels = strtoul(value, NULL, 0);
+		}
+		if(!std::strcmp(option, "--benchmark"))
+		{
+			if(!(benchmark_name = get_option_value(argc, argv, carg)))
+				return 1;
+			// the MML file is optional for some benchmarks
+			if(carg + 1 < argc && argv[carg + 1][0] != '-')
+				benchmark_input = argv[++carg];
+		}
+		if(!std::strcmp(option, "--rate"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			render_rate = strtoul(value, NULL, 0);
+		}
+		if(!std::strcmp(option, "--length"))
+		{
+			if(!(value = get_option_value(argc, argv, carg)))
+				return 1;
+			render_length = strtod(value, NULL);
 		}
 		carg++;
 	}
 
+	// Headless mode
+	if(render_input)
+		return render_file(render_input, render_output, render_rate, render_length, render_stems,
+			output_format, output_channels);
+	if(benchmark_name)
+		return run_benchmark(benchmark_name, {benchmark_input, render_rate, render_length});
+
 	// Setup window
 	glfwSetErrorCallback(glfw_error_callback);
 	if (!glfwInit())
@@ -133,6 +228,9 @@ int main(int argc, char* argv[])
 	glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE);
 
 	Audio_Manager::get().set_sample_rate(44100);
+	if(Audio_Manager::get().set_output_format(output_format, output_channels))
+		fprintf(stderr, "Warning: %s with %d channels is not supported by the audio device. Using s16 stereo\n",
+			Sample_Converter::get_format_name(output_format), output_channels);
 
 	// Decide GL+GLSL versions
 #if __APPLE__
@@ -258,6 +356,9 @@ int main(int argc, char* argv[])
 		Window::modal_open = false;
 		main_window.display_all();
 
+		// release finished audio streams outside the audio thread
+		Audio_Manager::get().collect_streams();
+
 		// Rendering
 		ImGui::Render();
 		int display_w, display_h;
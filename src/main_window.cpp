@@ -3,9 +3,11 @@
 #include "editor_window.h"
 #include "config_window.h"
 #include "audio_manager.h"
+#include "compile_profiler.h"
 
 #include <iostream>
 #include <csignal>
+#include <cfloat>
 
 //=====================================================================
 static const char* version_string = "v0.1";
@@ -38,6 +40,7 @@ static bool debug_imgui_metrics = false;
 static bool debug_state_window = false;
 static bool debug_audio_window = false;
 static bool debug_ui_window = false;
+static bool debug_profiler_window = false;
 
 static void debug_menu()
 {
@@ -50,6 +53,7 @@ static void debug_menu()
 	ImGui::MenuItem("Select audio device", NULL, &debug_audio_window);
 	ImGui::MenuItem("Display dump state", NULL, &debug_state_window);
 	ImGui::MenuItem("UI settings", NULL, &debug_ui_window);
+	ImGui::MenuItem("Compile profiler", NULL, &debug_profiler_window);
 	if (ImGui::MenuItem("Quit"))
 	{
 		// if ctrl+shift was held, stimulate a segfault
@@ -138,6 +142,75 @@ static void debug_window()
 
 		ImGui::End();
 	}
+	if(debug_profiler_window)
+	{
+		static std::string json_status = "";
+		auto& profiler = Compile_Profiler::get();
+		auto history = profiler.get_history();
+
+		ImGui::SetNextWindowSize(ImVec2(700, 300), ImGuiCond_Once);
+		ImGui::Begin("Compile profiler", &debug_profiler_window);
+		if (ImGui::Button("Clear"))
+			profiler.clear();
+		ImGui::SameLine();
+		if (ImGui::Button("Save JSON"))
+		{
+			const char* filename = "compile_profile.json";
+			if(profiler.write_json(filename))
+				json_status = std::string("Saved to ") + filename;
+			else
+				json_status = std::string("Could not write ") + filename;
+		}
+		ImGui::SameLine();
+		ImGui::TextUnformatted(json_status.c_str());
+
+		std::vector<float> total_times;
+		for(auto && i : history)
+			total_times.push_back(i.total_time / 1000.0f);
+		ImGui::PlotLines("Latency (ms)", total_times.data(), total_times.size(), 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+		ImGui::BeginChild("profiles", ImGui::GetContentRegionAvail(), false, ImGuiWindowFlags_HorizontalScrollbar);
+		ImGui::Columns(4 + Compile_Profiler::PHASE_COUNT, "profile_columns");
+		ImGui::Text("Gen");
+		ImGui::NextColumn();
+		ImGui::Text("Lines");
+		ImGui::NextColumn();
+		ImGui::Text("Events");
+		ImGui::NextColumn();
+		ImGui::Text("Total");
+		ImGui::NextColumn();
+		for(int phase = 0; phase < Compile_Profiler::PHASE_COUNT; phase++)
+		{
+			ImGui::Text("%s", Compile_Profiler::get_phase_name((Compile_Profiler::Phase)phase));
+			ImGui::NextColumn();
+		}
+		ImGui::Separator();
+		// newest first
+		for(auto it = history.rbegin(); it != history.rend(); it++)
+		{
+			const char* status = it->cancelled ? " (cancelled)" : it->reused ? " (reused)" : !it->successful ? " (error)" : "";
+			ImGui::Text("%u%s", it->generation, status);
+			ImGui::NextColumn();
+			ImGui::Text("%u/%u", it->parsed_lines, it->line_count);
+			ImGui::NextColumn();
+			ImGui::Text("%u (%u trk)", it->event_count, it->track_count);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f ms", it->total_time / 1000.0);
+			if (ImGui::IsItemHovered() && it->background_passes)
+				ImGui::SetTooltip("%u background passes, %.2f ms", it->background_passes, it->background_time / 1000.0);
+			ImGui::NextColumn();
+			for(int phase = 0; phase < Compile_Profiler::PHASE_COUNT; phase++)
+			{
+				ImGui::Text("%.2f ms", it->time[phase] / 1000.0);
+				if (ImGui::IsItemHovered() && Compile_Profiler::counts_allocations)
+					ImGui::SetTooltip("%llu allocations", (unsigned long long)it->allocations[phase]);
+				ImGui::NextColumn();
+			}
+		}
+		ImGui::Columns(1);
+		ImGui::EndChild();
+		ImGui::End();
+	}
 }
 
 //=====================================================================
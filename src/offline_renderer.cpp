@@ -0,0 +1,178 @@
+#include "offline_renderer.h"
+#include "emu_player.h"
+#include "tempo_map.h"
+#include "wave_writer.h"
+#include "input.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//! Samples rendered per Emu_Player::get_sample() call.
+const unsigned int Offline_Renderer::buffer_size = 4096;
+
+//! Create a renderer.
+/*!
+ *  \exception InputError Song playback errors, for example missing samples or bad data.
+ */
+Offline_Renderer::Offline_Renderer(std::shared_ptr<Song> song, uint32_t sample_rate)
+	: player(new Emu_Player(song))
+	, sample_rate(sample_rate ? sample_rate : 1)
+	, format(Sample_Converter::S16)
+	, channels(2)
+	, length(0)
+	, mute_mask()
+	, rendered_samples(0)
+	, render_time(0)
+	, error_message()
+{
+	player->setup_stream(this->sample_rate);
+}
+
+Offline_Renderer::~Offline_Renderer()
+{
+}
+
+Offline_Renderer::Offline_Renderer(Offline_Renderer&&) = default;
+
+//! Set the maximum length to render, in seconds.
+void Offline_Renderer::set_length(double seconds)
+{
+	length = std::max(seconds, 0.0);
+}
+
+//! Set the channel mute masks, in the same format as Emu_Player::set_mute_mask().
+void Offline_Renderer::set_mute_mask(const std::map<int16_t,uint32_t>& mask)
+{
+	mute_mask = mask;
+}
+
+//! Set the sample format and channel count of the WAV file. The default is S16 stereo.
+void Offline_Renderer::set_output_format(Sample_Converter::Format new_format, unsigned int new_channels)
+{
+	format = new_format;
+	channels = new_channels ? new_channels : 1;
+}
+
+//! Limit the number of samples rendered at once by each sound chip. See Emu_Player::set_max_block_size().
+void Offline_Renderer::set_max_block_size(int samples)
+{
+	player->set_max_block_size(samples);
+}
+
+//! Measure the time spent updating DAC streams. See Emu_Player::set_time_streams().
+void Offline_Renderer::set_time_streams(bool enable)
+{
+	player->set_time_streams(enable);
+}
+
+//! Render the song to a WAV file.
+/*!
+ *  This can only be done once per renderer. If \p filename is empty, the
+ *  song is rendered without writing a file, which is used for benchmarks.
+ *
+ *  \return false if the file could not be written or the song could not
+ *          be played. See get_error_message().
+ */
+bool Offline_Renderer::render(const std::string& filename)
+{
+	auto start_time = std::chrono::steady_clock::now();
+	rendered_samples = 0;
+	render_time = 0;
+	error_message = "";
+
+	Wave_Writer writer;
+	bool write_file = filename.size();
+	if(write_file && !writer.open(filename, sample_rate, channels, format))
+	{
+		error_message = "Cannot open file '" + filename + "'";
+		return false;
+	}
+
+	try
+	{
+		player->set_mute_mask(mute_mask);
+
+		std::vector<WAVE_32BS> buffer(buffer_size);
+		uint64_t total_samples = length * sample_rate;
+		while(rendered_samples < total_samples && !player->get_finished())
+		{
+			unsigned int count = std::min<uint64_t>(total_samples - rendered_samples, buffer_size);
+			std::fill_n(buffer.begin(), count, WAVE_32BS{0, 0});
+			player->get_sample(buffer.data(), count, 2);
+			if(write_file && !writer.write(buffer.data(), count))
+			{
+				error_message = "Cannot write to file '" + filename + "'";
+				return false;
+			}
+			rendered_samples += count;
+		}
+		player->stop_stream();
+		error_message = player->get_error_message();
+		if(error_message.size())
+			return false;
+	}
+	catch(InputError& e)
+	{
+		error_message = e.what();
+		return false;
+	}
+	catch(std::exception& e)
+	{
+		error_message = e.what();
+		return false;
+	}
+
+	if(write_file && !writer.close())
+	{
+		error_message = "Cannot write to file '" + filename + "'";
+		return false;
+	}
+	render_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	return true;
+}
+
+//! Get the default render length of a song, in seconds.
+/*!
+ *  This is the length of the longest track, with the loop section
+ *  played twice.
+ */
+double Offline_Renderer::get_song_length(const std::map<int, Track_Info>& tracks, const Tempo_Map& tempo_map)
+{
+	unsigned int ticks = 0;
+	for(auto && i : tracks)
+		ticks = std::max(ticks, i.second.length + i.second.loop_length);
+	return tempo_map.get_seconds(ticks);
+}
+
+//! Get the speed of the last render, relative to real time.
+double Offline_Renderer::get_realtime_factor() const
+{
+	if(render_time <= 0)
+		return 0;
+	return get_rendered_length() / render_time;
+}
+
+//! Get the number of times each sound chip was rendered.
+uint64_t Offline_Renderer::get_block_count() const
+{
+	return player->get_render_stats().blocks;
+}
+
+//! Get the number of sound driver steps.
+uint64_t Offline_Renderer::get_driver_steps() const
+{
+	return player->get_render_stats().driver_steps;
+}
+
+//! Get the number of bytes written to the sound chips by DAC streams.
+uint64_t Offline_Renderer::get_dac_writes() const
+{
+	return player->get_render_stats().dac_writes;
+}
+
+//! Get the time spent updating DAC streams, if enabled with set_time_streams().
+double Offline_Renderer::get_stream_time() const
+{
+	return player->get_render_stats().stream_time;
+}
@@ -0,0 +1,73 @@
+#ifndef OFFLINE_RENDERER_H
+#define OFFLINE_RENDERER_H
+
+#include <memory>
+#include <string>
+#include <map>
+
+#include "song.h"
+#include "track_info.h"
+#include "sample_converter.h"
+
+class Tempo_Map;
+class Emu_Player;
+
+//! Renders a song to a WAV file without an audio device.
+/*!
+ *  An Emu_Player is run directly in the calling thread, as fast as
+ *  possible. Rendering stops at the end of the requested length, or
+ *  earlier if the song stops or a playback error occurs.
+ *
+ *  Each renderer has its own player, so several songs, or several mute
+ *  masks of the same song, can be rendered on different threads. The
+ *  player is created by the constructor; create renderers for the same
+ *  song from one thread.
+ */
+class Offline_Renderer
+{
+	public:
+		Offline_Renderer(std::shared_ptr<Song> song, uint32_t sample_rate);
+		virtual ~Offline_Renderer();
+
+		Offline_Renderer(Offline_Renderer&&);
+
+		void set_length(double seconds);
+		void set_mute_mask(const std::map<int16_t,uint32_t>& mask);
+		void set_output_format(Sample_Converter::Format new_format, unsigned int new_channels);
+		void set_max_block_size(int samples);
+		void set_time_streams(bool enable);
+		bool render(const std::string& filename);
+
+		static double get_song_length(const std::map<int, Track_Info>& tracks, const Tempo_Map& tempo_map);
+
+		//! Get the error message if render() failed.
+		inline const std::string& get_error_message() const { return error_message; }
+
+		//! Get the length of the rendered audio in seconds.
+		inline double get_rendered_length() const { return (double)rendered_samples / sample_rate; }
+
+		//! Get the time spent rendering in seconds.
+		inline double get_render_time() const { return render_time; }
+
+		double get_realtime_factor() const;
+		uint64_t get_block_count() const;
+		uint64_t get_driver_steps() const;
+		uint64_t get_dac_writes() const;
+		double get_stream_time() const;
+
+		const static unsigned int buffer_size;
+
+	private:
+		std::unique_ptr<Emu_Player> player;
+		uint32_t sample_rate;
+		Sample_Converter::Format format;
+		unsigned int channels;
+		double length;
+		std::map<int16_t,uint32_t> mute_mask;
+
+		uint64_t rendered_samples;
+		double render_time;
+		std::string error_message;
+};
+
+#endif
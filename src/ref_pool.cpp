@@ -0,0 +1,195 @@
+#include "ref_pool.h"
+
+#include <stdexcept>
+
+const Ref_Pool::Id Ref_Pool::invalid_id = UINT32_MAX;
+
+// Maximum number of shards
+const unsigned int Ref_Pool::max_shards = 256;
+
+// Bits of an id used for the index in the shard. The remaining bits hold the shard index.
+const unsigned int Ref_Pool::index_bits = 24;
+
+// Size of the first chunk of a shard. Each following chunk is twice as big.
+const unsigned int Ref_Pool::Shard::chunk_size = 64;
+
+// Maximum number of chunks. 20 chunks hold more than the 2^24 references allowed by index_bits.
+const unsigned int Ref_Pool::Shard::max_chunks = 20;
+
+//=====================================================================
+Ref_Pool::Shard::Shard(unsigned int index)
+	: index(index)
+	, count(0)
+	, chunks(max_chunks)
+	, table_bits(0)
+	, table(chunk_size * 2, {nullptr, invalid_id})
+{
+	while((1u << table_bits) < table.size())
+		table_bits++;
+}
+
+//! Get the id of a reference, adding it to the shard if needed.
+/*!
+ *  Only the thread owning the shard may call this.
+ *
+ *  \return invalid_id if \p ref is null.
+ *  \exception std::length_error if the shard is full.
+ */
+Ref_Pool::Id Ref_Pool::Shard::intern(const std::shared_ptr<InputRef>& ref)
+{
+	// an empty slot has a null ref, so a null ref can't be looked up
+	if(!ref)
+		return invalid_id;
+	auto& slot = table[lookup(ref.get())];
+	if(slot.ref)
+		return slot.id;
+	return insert(ref);
+}
+
+//! Get the ids of a list of references, adding them to the shard if needed.
+/*!
+ *  The ids are appended to \p ids. Null references are skipped. Only the
+ *  thread owning the shard may call this.
+ *
+ *  \exception std::length_error if the shard is full.
+ */
+void Ref_Pool::Shard::intern(const std::vector<std::shared_ptr<InputRef>>& refs, std::vector<Id>& ids)
+{
+	for(auto && ref : refs)
+	{
+		if(ref)
+			ids.push_back(intern(ref));
+	}
+}
+
+//! Find the hash table slot of a reference, or the empty slot where it would be inserted.
+std::size_t Ref_Pool::Shard::lookup(const InputRef* ref) const
+{
+	// Fibonacci hashing. The top bits of the product depend on all bits of the pointer.
+	std::size_t mask = table.size() - 1;
+	std::size_t pos = ((uint64_t)(uintptr_t)ref * 0x9e3779b97f4a7c15ull) >> (64 - table_bits);
+	while(table[pos & mask].ref != ref && table[pos & mask].ref != nullptr)
+		pos++;
+	return pos & mask;
+}
+
+Ref_Pool::Id Ref_Pool::Shard::insert(const std::shared_ptr<InputRef>& ref)
+{
+	uint32_t ref_index = count.load(std::memory_order_relaxed);
+	if(ref_index >= (1u << index_bits) - 1)
+		throw std::length_error("Ref_Pool shard is full");
+
+	// Find the chunk. Chunk n starts at index (chunk_size << n) - chunk_size.
+	unsigned int chunk = 0;
+	for(uint32_t i = ref_index / chunk_size + 1; i > 1; i >>= 1)
+		chunk++;
+	uint32_t offset = ref_index - ((chunk_size << chunk) - chunk_size);
+	if(!chunks[chunk])
+		chunks[chunk].reset(new std::shared_ptr<InputRef>[chunk_size << chunk]);
+	chunks[chunk][offset] = ref;
+
+	Id id = (index << index_bits) | ref_index;
+	std::lock_guard<std::mutex> guard(mutex);
+	if((ref_index + 1) * 2 > table.size())
+		grow_table();
+	table[lookup(ref.get())] = {ref.get(), id};
+	count.store(ref_index + 1, std::memory_order_release);
+	return id;
+}
+
+//! Double the size of the hash table. Must be called with the lock held.
+void Ref_Pool::Shard::grow_table()
+{
+	std::vector<Slot> old_table(table.size() * 2, {nullptr, invalid_id});
+	old_table.swap(table);
+	table_bits++;
+	for(auto && slot : old_table)
+	{
+		if(slot.ref)
+			table[lookup(slot.ref)] = slot;
+	}
+}
+
+InputRef* Ref_Pool::Shard::get(uint32_t ref_index) const
+{
+	unsigned int chunk = 0;
+	for(uint32_t i = ref_index / chunk_size + 1; i > 1; i >>= 1)
+		chunk++;
+	return chunks[chunk][ref_index - ((chunk_size << chunk) - chunk_size)].get();
+}
+
+//=====================================================================
+Ref_Pool::Ref_Pool()
+	: shard_count(0)
+	, shards(max_shards)
+{
+}
+
+//! Add a shard for a thread that adds references.
+/*!
+ *  The shard belongs to the pool and stays valid as long as the pool.
+ *
+ *  \exception std::length_error if the pool already has max_shards shards.
+ */
+Ref_Pool::Shard& Ref_Pool::add_shard()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	unsigned int shard = shard_count.load(std::memory_order_relaxed);
+	if(shard >= max_shards)
+		throw std::length_error("Too many Ref_Pool shards");
+	shards[shard].reset(new Shard(shard));
+	shard_count.store(shard + 1, std::memory_order_release);
+	return *shards[shard];
+}
+
+//! Find the id of a reference.
+/*!
+ *  A reference used by several generators has one id in each shard.
+ *  Use the other overload to find all of them.
+ *
+ *  \return invalid_id if the reference is not in the pool.
+ */
+Ref_Pool::Id Ref_Pool::find(const InputRef* ref) const
+{
+	unsigned int count = shard_count.load(std::memory_order_acquire);
+	for(unsigned int i = 0; i < count; i++)
+	{
+		std::lock_guard<std::mutex> guard(shards[i]->mutex);
+		auto& slot = shards[i]->table[shards[i]->lookup(ref)];
+		if(slot.ref)
+			return slot.id;
+	}
+	return invalid_id;
+}
+
+//! Find all ids of a reference.
+/*!
+ *  The ids are appended to \p ids.
+ */
+void Ref_Pool::find(const InputRef* ref, std::vector<Id>& ids) const
+{
+	unsigned int count = shard_count.load(std::memory_order_acquire);
+	for(unsigned int i = 0; i < count; i++)
+	{
+		std::lock_guard<std::mutex> guard(shards[i]->mutex);
+		auto& slot = shards[i]->table[shards[i]->lookup(ref)];
+		if(slot.ref)
+			ids.push_back(slot.id);
+	}
+}
+
+//! Get a reference by id.
+InputRef* Ref_Pool::get(Id id) const
+{
+	return shards[id >> index_bits]->get(id & ((1u << index_bits) - 1));
+}
+
+//! Get the number of references in the pool.
+std::size_t Ref_Pool::size() const
+{
+	std::size_t size = 0;
+	unsigned int count = shard_count.load(std::memory_order_acquire);
+	for(unsigned int i = 0; i < count; i++)
+		size += shards[i]->count.load(std::memory_order_acquire);
+	return size;
+}
@@ -0,0 +1,103 @@
+#ifndef REF_POOL_H
+#define REF_POOL_H
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "input.h"
+
+//! Interned InputRef pointers for a compile result.
+/*!
+ *  Each distinct reference is stored once and identified by an integer
+ *  id, so that Track_Info events can refer to a range of ids instead of
+ *  holding their own shared pointers. Ids are only valid for the pool
+ *  that created them.
+ *
+ *  References are added through a Shard. Each Track_Info_Generator has
+ *  its own shard, so generators running in parallel do not share a lock
+ *  and a reference that is already in the shard is found without
+ *  locking. The upper bits of an id select the shard.
+ *
+ *  get() and size() never lock. Stored references are never moved, so
+ *  an id can be read while other references are added, as long as the id
+ *  was passed to the reading thread through a synchronized hand-off, such
+ *  as a compile snapshot. find() locks each shard in turn.
+ */
+class Ref_Pool
+{
+	public:
+		typedef uint32_t Id;
+		const static Id invalid_id;
+		const static unsigned int max_shards;
+
+		//! References added by one thread.
+		class Shard
+		{
+			public:
+				// not copyable
+				Shard(Shard const&) = delete;
+				void operator=(Shard const&) = delete;
+
+				Id intern(const std::shared_ptr<InputRef>& ref);
+				void intern(const std::vector<std::shared_ptr<InputRef>>& refs, std::vector<Id>& ids);
+
+			private:
+				friend class Ref_Pool;
+
+				//! Hash table entry.
+				struct Slot
+				{
+					const InputRef* ref;
+					Id id;
+				};
+
+				Shard(unsigned int index);
+
+				Id insert(const std::shared_ptr<InputRef>& ref);
+				std::size_t lookup(const InputRef* ref) const;
+				void grow_table();
+				InputRef* get(uint32_t index) const;
+
+				const static unsigned int chunk_size;
+				const static unsigned int max_chunks;
+
+				unsigned int index;
+				std::atomic<uint32_t> count;
+
+				// Chunk n holds chunk_size << n references. Neither the chunks nor
+				// this list are reallocated, so they can be read without locking.
+				std::vector<std::unique_ptr<std::shared_ptr<InputRef>[]>> chunks;
+
+				// Open addressing hash table. Modified only with the lock held by
+				// the owning thread, which may read it without locking.
+				mutable std::mutex mutex;
+				unsigned int table_bits;		// log2 of the table size
+				std::vector<Slot> table;
+		};
+
+		Ref_Pool();
+
+		// not copyable
+		Ref_Pool(Ref_Pool const&) = delete;
+		void operator=(Ref_Pool const&) = delete;
+
+		Shard& add_shard();
+
+		Id find(const InputRef* ref) const;
+		void find(const InputRef* ref, std::vector<Id>& ids) const;
+
+		InputRef* get(Id id) const;
+		std::size_t size() const;
+
+	private:
+		const static unsigned int index_bits;
+
+		std::mutex mutex;
+		std::atomic<unsigned int> shard_count;
+		std::vector<std::unique_ptr<Shard>> shards;		// allocated once, never resized
+};
+
+#endif
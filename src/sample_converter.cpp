@@ -0,0 +1,357 @@
+#include "sample_converter.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// SSE4.1 kernels are compiled with a target attribute and selected at
+// run time, so the rest of the program does not require SSE4.1.
+#if defined(__SSE2__) && defined(__GNUC__)
+#define SSE41_DISPATCH
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#include <smmintrin.h>
+#endif
+
+#if defined(__SSE2__)
+const bool Sample_Converter::simd_enabled = true;
+#else
+const bool Sample_Converter::simd_enabled = false;
+#endif
+
+static bool detect_sse41()
+{
+#if defined(__SSE4_1__)
+	return true;
+#elif defined(SSE41_DISPATCH)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1");
+#else
+	return false;
+#endif
+}
+
+const bool Sample_Converter::sse41_enabled = detect_sse41();
+
+// Scale from mixed samples to float
+static const float float_scale = 1.0f / 8388608.0f;
+
+static inline int16_t clip_s16(int32_t input)
+{
+	input >>= 8;
+	if(input > 32767)
+		input = 32767;
+	else if(input < -32768)
+		input = -32768;
+	return input;
+}
+
+static inline int32_t clip_s24(int32_t input)
+{
+	if(input > 8388607)
+		input = 8388607;
+	else if(input < -8388608)
+		input = -8388608;
+	return input;
+}
+
+static inline float clip_f32(int32_t input)
+{
+	float output = (float)input * float_scale;
+	if(output > 1.0f)
+		output = 1.0f;
+	else if(output < -1.0f)
+		output = -1.0f;
+	return output;
+}
+
+static inline uint8_t* store_s24(int32_t input, uint8_t* output)
+{
+	*output++ = input;
+	*output++ = input >> 8;
+	*output++ = input >> 16;
+	return output;
+}
+
+#if defined(SSE41_DISPATCH)
+//! Multiply samples by a gain. Returns the number of frames done.
+/*!
+ *  mul_epi32 multiplies the even lanes to 64 bits. Bits 16-47 of the
+ *  product are the result, which is moved into place with 64-bit shifts
+ *  and merged with a blend.
+ */
+TARGET_SSE41 static unsigned int apply_gain_sse41(WAVE_32BS* samples, unsigned int count, int32_t gain)
+{
+	unsigned int done = 0;
+	__m128i* ptr = (__m128i*)samples;
+	const __m128i g = _mm_set1_epi32(gain);
+	for(; done + 2 <= count; done += 2, ptr++)
+	{
+		__m128i a = _mm_loadu_si128(ptr);
+		__m128i even = _mm_srli_epi64(_mm_mul_epi32(a, g), 16);
+		__m128i odd = _mm_slli_epi64(_mm_mul_epi32(_mm_srli_epi64(a, 32), g), 16);
+		_mm_storeu_si128(ptr, _mm_blend_epi16(even, odd, 0xcc));
+	}
+	return done;
+}
+
+//! Convert stereo samples to packed 24-bit. Returns the number of frames done.
+/*!
+ *  4 frames are clipped with 32-bit min/max, and the low 3 bytes of each
+ *  sample are gathered with byte shuffles into 24 output bytes.
+ */
+TARGET_SSE41 static unsigned int to_s24_sse41(const WAVE_32BS* input, uint8_t* output, unsigned int count)
+{
+	unsigned int done = 0;
+	const __m128i* in = (const __m128i*)input;
+	const __m128i max = _mm_set1_epi32(8388607);
+	const __m128i min = _mm_set1_epi32(-8388608);
+	// first vector to bytes 0-11
+	const __m128i pack_a = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	// second vector to bytes 12-15 ...
+	const __m128i pack_b_low = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 4);
+	// ... and 16-23
+	const __m128i pack_b_high = _mm_setr_epi8(5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+	for(; done + 4 <= count; done += 4, in += 2, output += 24)
+	{
+		__m128i a = _mm_max_epi32(_mm_min_epi32(_mm_loadu_si128(in), max), min);
+		__m128i b = _mm_max_epi32(_mm_min_epi32(_mm_loadu_si128(in + 1), max), min);
+		__m128i low = _mm_or_si128(_mm_shuffle_epi8(a, pack_a), _mm_shuffle_epi8(b, pack_b_low));
+		_mm_storeu_si128((__m128i*)output, low);
+		_mm_storel_epi64((__m128i*)(output + 16), _mm_shuffle_epi8(b, pack_b_high));
+	}
+	return done;
+}
+#endif
+
+//! Write one sample and return the position of the next.
+static inline uint8_t* store_sample(Sample_Converter::Format format, int32_t input, uint8_t* output)
+{
+	switch(format)
+	{
+		default:
+		case Sample_Converter::S16:
+		{
+			int16_t sample = clip_s16(input);
+			std::memcpy(output, &sample, sizeof(sample));
+			return output + sizeof(sample);
+		}
+		case Sample_Converter::S24:
+		{
+			return store_s24(clip_s24(input), output);
+		}
+		case Sample_Converter::F32:
+		{
+			float sample = clip_f32(input);
+			std::memcpy(output, &sample, sizeof(sample));
+			return output + sizeof(sample);
+		}
+	}
+}
+
+Sample_Converter::Sample_Converter(Format format, unsigned int channels)
+	: format(format)
+	, channels(channels ? channels : 1)
+{
+}
+
+//! Convert samples to the output format.
+/*!
+ *  \param input Mixed stereo samples.
+ *  \param output Output buffer, count * get_frame_size() bytes.
+ *  \param count Number of sample frames.
+ */
+void Sample_Converter::convert(const WAVE_32BS* input, void* output, unsigned int count) const
+{
+	if(channels != 2)
+	{
+		convert_channels(input, (uint8_t*)output, count);
+		return;
+	}
+	switch(format)
+	{
+		default:
+		case S16:
+			to_s16(input, (int16_t*)output, count);
+			break;
+		case S24:
+			to_s24(input, (uint8_t*)output, count);
+			break;
+		case F32:
+			to_f32(input, (float*)output, count);
+			break;
+	}
+}
+
+//! Get the size of one sample in bytes.
+unsigned int Sample_Converter::get_sample_size(Format format)
+{
+	switch(format)
+	{
+		default:
+		case S16:
+			return 2;
+		case S24:
+			return 3;
+		case F32:
+			return 4;
+	}
+}
+
+//! Get the name of a format, as used on the command line.
+const char* Sample_Converter::get_format_name(Format format)
+{
+	switch(format)
+	{
+		default:
+		case S16:
+			return "s16";
+		case S24:
+			return "s24";
+		case F32:
+			return "f32";
+	}
+}
+
+//! Look up a format by name.
+/*!
+ *  \return false if the name is unknown.
+ */
+bool Sample_Converter::find_format(const std::string& name, Format& format)
+{
+	for(Format i : {S16, S24, F32})
+	{
+		if(name == get_format_name(i))
+		{
+			format = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//! Multiply samples by a gain in 16.16 fixed point.
+/*!
+ *  The result is the same as ((int64_t)sample * gain) >> 16.
+ *
+ *  SSE2 has no signed 32x32 to 64 bit multiply, and a corrected unsigned
+ *  multiply was no faster than the scalar loop, so without SSE4.1 the
+ *  scalar kernel is used.
+ */
+void Sample_Converter::apply_gain(WAVE_32BS* samples, unsigned int count, int32_t gain)
+{
+	unsigned int done = 0;
+#if defined(SSE41_DISPATCH)
+	if(sse41_enabled)
+		done = apply_gain_sse41(samples, count, gain);
+#endif
+	apply_gain_scalar(samples + done, count - done, gain);
+}
+
+//! Convert stereo samples to 16-bit.
+void Sample_Converter::to_s16(const WAVE_32BS* input, int16_t* output, unsigned int count)
+{
+	unsigned int done = 0;
+#if defined(__SSE2__)
+	// packs_epi32 saturates to the 16-bit range
+	const __m128i* in = (const __m128i*)input;
+	__m128i* out = (__m128i*)output;
+	for(; done + 4 <= count; done += 4, in += 2, out++)
+	{
+		__m128i a = _mm_srai_epi32(_mm_loadu_si128(in), 8);
+		__m128i b = _mm_srai_epi32(_mm_loadu_si128(in + 1), 8);
+		_mm_storeu_si128(out, _mm_packs_epi32(a, b));
+	}
+#endif
+	to_s16_scalar(input + done, output + done * 2, count - done);
+}
+
+//! Convert stereo samples to packed 24-bit.
+/*!
+ *  SSE2 has no 32-bit min/max or byte shuffle, so the bytes must be
+ *  packed one at a time. An SSE2 kernel was slower than the scalar one,
+ *  so without SSE4.1 the scalar kernel is used.
+ */
+void Sample_Converter::to_s24(const WAVE_32BS* input, uint8_t* output, unsigned int count)
+{
+	unsigned int done = 0;
+#if defined(SSE41_DISPATCH)
+	if(sse41_enabled)
+		done = to_s24_sse41(input, output, count);
+#endif
+	to_s24_scalar(input + done, output + done * 6, count - done);
+}
+
+//! Convert stereo samples to float.
+void Sample_Converter::to_f32(const WAVE_32BS* input, float* output, unsigned int count)
+{
+	unsigned int done = 0;
+#if defined(__SSE2__)
+	const __m128i* in = (const __m128i*)input;
+	const __m128 scale = _mm_set1_ps(float_scale);
+	const __m128 max = _mm_set1_ps(1.0f);
+	const __m128 min = _mm_set1_ps(-1.0f);
+	for(; done + 2 <= count; done += 2, in++)
+	{
+		__m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(in)), scale);
+		a = _mm_max_ps(_mm_min_ps(a, max), min);
+		_mm_storeu_ps(output + done * 2, a);
+	}
+#endif
+	to_f32_scalar(input + done, output + done * 2, count - done);
+}
+
+void Sample_Converter::apply_gain_scalar(WAVE_32BS* samples, unsigned int count, int32_t gain)
+{
+	for(unsigned int i = 0; i < count; i++)
+	{
+		samples[i].L = ((int64_t)samples[i].L * gain) >> 16;
+		samples[i].R = ((int64_t)samples[i].R * gain) >> 16;
+	}
+}
+
+void Sample_Converter::to_s16_scalar(const WAVE_32BS* input, int16_t* output, unsigned int count)
+{
+	for(unsigned int i = 0; i < count; i++)
+	{
+		*output++ = clip_s16(input[i].L);
+		*output++ = clip_s16(input[i].R);
+	}
+}
+
+void Sample_Converter::to_s24_scalar(const WAVE_32BS* input, uint8_t* output, unsigned int count)
+{
+	for(unsigned int i = 0; i < count; i++)
+	{
+		output = store_s24(clip_s24(input[i].L), output);
+		output = store_s24(clip_s24(input[i].R), output);
+	}
+}
+
+void Sample_Converter::to_f32_scalar(const WAVE_32BS* input, float* output, unsigned int count)
+{
+	for(unsigned int i = 0; i < count; i++)
+	{
+		*output++ = clip_f32(input[i].L);
+		*output++ = clip_f32(input[i].R);
+	}
+}
+
+//! Convert to a channel count other than 2.
+void Sample_Converter::convert_channels(const WAVE_32BS* input, uint8_t* output, unsigned int count) const
+{
+	unsigned int silent_size = (channels > 2) ? (channels - 2) * get_sample_size(format) : 0;
+	for(unsigned int i = 0; i < count; i++)
+	{
+		if(channels == 1)
+		{
+			output = store_sample(format, ((int64_t)input[i].L + input[i].R) >> 1, output);
+			continue;
+		}
+		output = store_sample(format, input[i].L, output);
+		output = store_sample(format, input[i].R, output);
+		std::memset(output, 0, silent_size);
+		output += silent_size;
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef SAMPLE_CONVERTER_H
+#define SAMPLE_CONVERTER_H
+
+#include <cstdint>
+#include <string>
+
+#if defined(LOCAL_LIBVGM)
+#include "emu/EmuStructs.h"
+#else
+#include <vgm/emu/EmuStructs.h>
+#endif
+
+//! Conversion of mixed samples to output formats.
+/*!
+ *  Mixed samples are 16-bit samples with 8 fractional bits, as produced
+ *  by the libvgm resampler. Output is interleaved and clipped to the
+ *  range of the format. Integer formats are truncated, F32 is scaled to
+ *  -1.0 to 1.0. Output is in native byte order, except that S24 is
+ *  always packed little endian.
+ *
+ *  Stereo S16 and F32 conversion uses SSE2 kernels where available,
+ *  with scalar fallbacks that give identical output. Stereo S24 and
+ *  apply_gain() use SSE4.1 kernels if the CPU supports it, which is
+ *  checked at run time, and the scalar kernels otherwise. The scalar
+ *  kernels are public so that they can be tested and benchmarked
+ *  against the SIMD ones.
+ *
+ *  Other channel counts are converted by the scalar path. Mono is the
+ *  average of both channels; with more than 2 channels, the stereo mix
+ *  is output to the first 2 and the rest are silent.
+ */
+class Sample_Converter
+{
+	public:
+		enum Format
+		{
+			S16 = 0,
+			S24 = 1,
+			F32 = 2,
+		};
+
+		Sample_Converter(Format format = S16, unsigned int channels = 2);
+
+		void convert(const WAVE_32BS* input, void* output, unsigned int count) const;
+
+		inline Format get_format() const { return format; }
+		inline unsigned int get_channels() const { return channels; }
+
+		//! Get the size of one sample frame in bytes.
+		inline unsigned int get_frame_size() const { return channels * get_sample_size(format); }
+
+		static unsigned int get_sample_size(Format format);
+		static const char* get_format_name(Format format);
+		static bool find_format(const std::string& name, Format& format);
+
+		static void apply_gain(WAVE_32BS* samples, unsigned int count, int32_t gain);
+		static void to_s16(const WAVE_32BS* input, int16_t* output, unsigned int count);
+		static void to_s24(const WAVE_32BS* input, uint8_t* output, unsigned int count);
+		static void to_f32(const WAVE_32BS* input, float* output, unsigned int count);
+
+		static void apply_gain_scalar(WAVE_32BS* samples, unsigned int count, int32_t gain);
+		static void to_s16_scalar(const WAVE_32BS* input, int16_t* output, unsigned int count);
+		static void to_s24_scalar(const WAVE_32BS* input, uint8_t* output, unsigned int count);
+		static void to_f32_scalar(const WAVE_32BS* input, float* output, unsigned int count);
+
+		const static bool simd_enabled;
+		const static bool sse41_enabled;
+
+	private:
+		void convert_channels(const WAVE_32BS* input, uint8_t* output, unsigned int count) const;
+
+		Format format;
+		unsigned int channels;
+};
+
+#endif
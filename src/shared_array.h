@@ -0,0 +1,110 @@
+#ifndef SHARED_ARRAY_H
+#define SHARED_ARRAY_H
+
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+//! Append-only array where copies share the storage.
+/*!
+ *  Copying the array only copies a pointer to the storage and the element
+ *  count, so a growing array can be published to other threads without
+ *  copying the elements. A copy only sees the elements that existed when
+ *  it was made. Elements appended to the original afterwards are written
+ *  past the end of the copy.
+ *
+ *  Appending to an array that is not at the end of its storage, or to a
+ *  full storage, first copies the elements to a new storage with twice
+ *  the size, so appending stays amortized constant time.
+ *
+ *  Elements are never modified once appended. Copies can therefore be
+ *  read from other threads while the original is appended to, as long as
+ *  the copy was handed over with proper synchronization. Only one array
+ *  sharing a storage may be appended to at a time.
+ */
+template<class T>
+class Shared_Array
+{
+	public:
+		Shared_Array()
+			: storage(nullptr)
+			, count(0)
+		{}
+
+		Shared_Array(const Shared_Array& other) = default;
+		Shared_Array& operator=(const Shared_Array& other) = default;
+
+		Shared_Array(Shared_Array&& other)
+			: storage(std::move(other.storage))
+			, count(other.count)
+		{
+			other.count = 0;
+		}
+
+		Shared_Array& operator=(Shared_Array&& other)
+		{
+			storage = std::move(other.storage);
+			count = other.count;
+			other.count = 0;
+			return *this;
+		}
+
+		//! Append an element.
+		void push_back(const T& value)
+		{
+			reserve(count + 1);
+			storage->data[count++] = value;
+			storage->used = count;
+		}
+
+		//! Append a range of elements.
+		template<class It>
+		void append(It first, It last)
+		{
+			reserve(count + std::distance(first, last));
+			T* out = storage->data.get() + count;
+			count += std::copy(first, last, out) - out;
+			storage->used = count;
+		}
+
+		//! Remove all elements. The storage is released.
+		void clear()
+		{
+			storage = nullptr;
+			count = 0;
+		}
+
+		inline const T& operator[](std::size_t index) const { return storage->data[index]; }
+		inline const T& back() const { return storage->data[count - 1]; }
+		inline const T* begin() const { return storage ? storage->data.get() : nullptr; }
+		inline const T* end() const { return begin() + count; }
+		inline const T* data() const { return begin(); }
+		inline std::size_t size() const { return count; }
+		inline bool empty() const { return count == 0; }
+
+	private:
+		struct Storage
+		{
+			std::unique_ptr<T[]> data;
+			std::size_t capacity;
+			std::size_t used;			// elements written by the array appending to this storage
+		};
+
+		//! Make room for \p size elements, copying to a new storage if needed.
+		void reserve(std::size_t size)
+		{
+			if(storage != nullptr && count == storage->used && size <= storage->capacity)
+				return;
+			auto new_storage = std::make_shared<Storage>();
+			new_storage->capacity = std::max<std::size_t>({size, count * 2, 16});
+			new_storage->data.reset(new T[new_storage->capacity]);
+			std::copy(begin(), end(), new_storage->data.get());
+			new_storage->used = count;
+			storage = std::move(new_storage);
+		}
+
+		std::shared_ptr<Storage> storage;
+		std::size_t count;
+};
+
+#endif
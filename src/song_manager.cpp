@@ -5,15 +5,26 @@
 #include "player.h"
 
 #include "mml_input.h"
+#include "thread_pool.h"
+#include "length_table.h"
+#include "cursor_index.h"
+#include "timeline_index.h"
+#include "tempo_map.h"
+#include "compile_profiler.h"
+#include "source_text.h"
 
 #include <chrono>
 #include <iostream>
 #include <stdexcept>
-#include <sstream>
 #include <climits>
+#include <algorithm>
+#include <sys/stat.h>
 
 const int Song_Manager::max_channels = 16;
 
+// Ticks of Track_Info generated per pass. 0 to generate everything in the first pass.
+unsigned int Song_Manager::track_info_budget = 10000;
+
 // TODO : Use Song to get the correct map for each platform
 const std::map<uint16_t, std::pair<int16_t,uint32_t>> Song_Manager::track_channel_table = {
 	{0, {2, 1<<0}}, // YM2612
@@ -41,14 +52,22 @@ const std::map<uint16_t, std::pair<int16_t,uint32_t>> Song_Manager::track_channe
 Song_Manager::Song_Manager()
 	: worker_ptr(nullptr)
 	, worker_fired(false)
-	, job_done(false)
-	, job_successful(false)
-	, song(nullptr)
+	, job_pending(false)
+	, stats({0, 0, 0, 0})
+	, job_generation(0)
+	, latest_generation(0)
+	, view_end(0)
+	, last_valid(false)
+	, snapshot(nullptr)
 	, player(nullptr)
 	, editor_position({-1, -1})
 	, editor_jump_hack(false)
 	, song_pos_at_line(0)
 	, song_pos_at_cursor(0)
+	, editor_cache_valid(false)
+	, editor_generation(0)
+	, editor_pass(0)
+	, editor_cache_stats({0, 0})
 {
 	reset_mute();
 }
@@ -58,72 +77,70 @@ Song_Manager::~Song_Manager()
 {
 	if(worker_ptr && worker_ptr->joinable())
 	{
+		bool in_progress = get_compile_in_progress();
 		{
-			// kill worker thread
+			// kill worker thread and cancel the ongoing job
 			std::lock_guard<std::mutex> guard(mutex);
 			worker_fired = true;
+			latest_generation = ++job_generation;
 		}
 		condition_variable.notify_one();
 
-		if(!job_done)
-		{
-			// detach the compile thread in order to not crash the entire application
-			std::cerr << "Song_Manager killed during ongoing compile job. Compiler stuck?\n";
-			worker_ptr->detach();
-		}
-		else
-		{
-			// wait for compile thread to end normally
-			worker_ptr->join();
-		}
+		// The job stops at the next line or Track_Info pass. The worker uses
+		// this object, so it must finish before the destructor returns.
+		if(in_progress)
+			std::cerr << "Song_Manager destroyed during ongoing compile job, waiting for it to stop\n";
+		worker_ptr->join();
 	}
 }
 
 //! Get compile result
-Song_Manager::Compile_Result Song_Manager::get_compile_result()
+Song_Manager::Compile_Result Song_Manager::get_compile_result() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	if(!job_done || !worker_ptr)
+	auto result = get_snapshot();
+	if(result == nullptr || result->generation != latest_generation.load())
 		return COMPILE_NOT_DONE;
-	else if(job_successful)
+	else if(result->successful)
 		return COMPILE_OK;
 	else
 		return COMPILE_ERROR;
 }
 
 //! Get compile in progress
-bool Song_Manager::get_compile_in_progress()
+bool Song_Manager::get_compile_in_progress() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	if(!worker_ptr)
-		return false;
+	auto result = get_snapshot();
+	if(result == nullptr)
+		return latest_generation.load() != 0;
 	else
-		return !job_done;
+		return result->generation != latest_generation.load();
 }
 
 //! Compile from a buffer
-/*
- *  \return non-zero if compile thread was busy.
- *  \return zero if compile was successfully started
+/*!
+ *  If a compile job is already waiting, it is replaced by this one. If a job is
+ *  currently running, it is cancelled at the next line boundary and its result
+ *  is discarded.
+ *
+ *  \return zero if compile was successfully queued.
  */
-int Song_Manager::compile(const std::string& buffer, const std::string& filename)
+int Song_Manager::compile(std::shared_ptr<const Source_Text> text, const std::string& filename)
 {
 	{
 		std::lock_guard<std::mutex> guard(mutex);
-		if(job_done || !worker_ptr)
-		{
-			if(!worker_ptr)
-				worker_ptr = std::make_unique<std::thread>(&Song_Manager::worker, this);
-
-			job_buffer = buffer;
-			job_filename = filename;
-			job_done = 0;
-			job_successful = 0;
-		}
-		else
-		{
-			return -1;
-		}
+		if(!worker_ptr)
+			worker_ptr = std::make_unique<std::thread>(&Song_Manager::worker, this);
+
+		if(job_pending)
+			stats.superseded++;
+		stats.submitted++;
+
+		job_text = std::move(text);
+		job_filename = filename;
+		job_start_time = std::chrono::steady_clock::now();
+		job_generation++;
+		job_pending = true;
+		latest_generation = job_generation;
 	}
 	condition_variable.notify_one();
 	return 0;
@@ -153,11 +170,22 @@ void Song_Manager::stop()
 	}
 }
 
+//! Get the latest compile result.
+/*!
+ *  The UI should get the snapshot once per frame and use it for all drawing,
+ *  so that data from different compiles is not mixed. This does not lock the
+ *  worker mutex.
+ */
+std::shared_ptr<const Song_Manager::Compile_Snapshot> Song_Manager::get_snapshot() const
+{
+	return std::atomic_load(&snapshot);
+}
+
 //! Get song data
-std::shared_ptr<Song> Song_Manager::get_song()
+std::shared_ptr<Song> Song_Manager::get_song() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	return song;
+	auto result = get_snapshot();
+	return (result != nullptr) ? result->song : nullptr;
 }
 
 //! Get player
@@ -167,123 +195,83 @@ std::shared_ptr<Emu_Player> Song_Manager::get_player()
 }
 
 //! Get track info data
-std::shared_ptr<std::map<int,Track_Info>> Song_Manager::get_tracks()
+std::shared_ptr<Song_Manager::Track_Map> Song_Manager::get_tracks() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	return tracks;
+	auto result = get_snapshot();
+	return (result != nullptr) ? result->tracks : nullptr;
 }
 
 //! Get line info
-std::shared_ptr<Song_Manager::Line_Map> Song_Manager::get_lines()
+std::shared_ptr<Line_Map> Song_Manager::get_lines() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	return lines;
+	auto result = get_snapshot();
+	return (result != nullptr) ? result->lines : nullptr;
 }
 
 //! Get error message
-std::string Song_Manager::get_error_message()
+std::string Song_Manager::get_error_message() const
 {
-	std::lock_guard<std::mutex> guard(mutex);
-	return error_message;
+	auto result = get_snapshot();
+	return (result != nullptr) ? result->error_message : "";
 }
 
-//! Check if event is a note or subroutine call
-static inline bool is_note_or_jump(Event::Type type)
+//! Get compile scheduler statistics.
+Song_Manager::Compile_Stats Song_Manager::get_compile_stats()
 {
-	if(type == Event::NOTE || type == Event::TIE || type == Event::REST || type == Event::JUMP)
-		return true;
-	else
-		return false;
+	std::lock_guard<std::mutex> guard(mutex);
+	return stats;
 }
 
-//! Check if event is a loop end
-static inline bool is_loop_event(Event::Type type)
+//! Set the end of the area visible in the track view.
+/*!
+ *  Track_Info up to this position is generated before the compile result
+ *  is published, or in the next background pass.
+ */
+void Song_Manager::set_view_end(unsigned int ticks)
 {
-	if(type == Event::LOOP_START || type == Event::LOOP_BREAK || type == Event::LOOP_END)
-		return true;
-	else
-		return false;
+	view_end = ticks;
 }
 
-//! Get the length of a loop section.
-static unsigned int get_loop_length(Song& song, Track& track, unsigned int position, InputRef*& refptr, unsigned int max_recursion)
-{
-	// This function is a hack only needed in the case where a subroutine ends with a loop section.
-	// Until I properly count the length of subroutines again, this will be necessary.
-	// Example: passport.mml:177
-	int depth = 0;
-	int count = track.get_event(position).param - 1;
-	int start_time = 0;
-	int end_time = track.get_event(position).play_time;
-	int break_time = 0;
-	refptr = nullptr;
-	while(position-- > 0)
-	{
-		auto event = track.get_event(position);
-		start_time = event.play_time;
-		if(is_note_or_jump(event.type) && refptr == nullptr)
-		{
-			refptr = event.reference.get();
-		}
-		else if(event.type == Event::LOOP_END)
-		{
-			if(refptr == nullptr)
-				get_loop_length(song, track, position, refptr, max_recursion - 1);
-			depth++;
-		}
-		else if(event.type == Event::LOOP_BREAK && !depth)
-		{
-			break_time = end_time - event.play_time;
-			refptr = nullptr;
-		}
-		else if(event.type == Event::LOOP_START)
-		{
-			if(depth)
-				depth--;
-			else
-				break;
-		}
-	}
-	unsigned int result = (end_time - start_time) * count - break_time;
-	return result;
-}
-
-//! Get the length of a subroutine.
-static unsigned int get_subroutine_length(Song& song, unsigned int param, unsigned int max_recursion)
+//! Set the number of ticks of Track_Info generated per pass.
+/*!
+ *  Call this before creating any Song_Manager. 0 generates all
+ *  Track_Info before the compile result is published.
+ */
+void Song_Manager::set_track_info_budget(unsigned int ticks)
 {
-	try
-	{
-		Track& track = song.get_track(param);
-		InputRef* dummy;
-		if(track.get_event_count())
-		{
-			auto event = track.get_event(track.get_event_count() - 1);
-			uint32_t end_time;
-			if(event.type == Event::JUMP && max_recursion != 0)
-				end_time = event.play_time + get_subroutine_length(song, event.param, max_recursion - 1);
-			else if(event.type == Event::LOOP_END && max_recursion != 0)
-				end_time = event.play_time + get_loop_length(song, track, track.get_event_count() - 1, dummy, max_recursion - 1);
-			else
-				end_time = event.play_time + event.on_time + event.off_time;
-			return end_time - track.get_event(0).play_time;
-		}
-	}
-	catch(std::exception &e)
-	{
-	}
-	return 0;
+	track_info_budget = ticks;
 }
 
 //! Set the current editor position, and find any events adjacent to the editor cursor.
 /*!
  *  Call this function from the UI thread.
  *
- *  Cursor should be displayed if an InputRef* from editor_refs can be also found in the Track_Info array (tracks).
+ *  Cursor should be displayed if a reference id from editor_refs can be also found in the Track_Info array (tracks).
  *
  *  This approach is not perfect, there are a few things that need to be looked into.
+ *
+ *  The result is kept until the cursor moves or a new compile result is published,
+ *  so calling this every frame is cheap.
  */
 void Song_Manager::set_editor_position(const Editor_Position& d)
 {
+	// Take ownership of the song and track info pointers.
+	auto result = get_snapshot();
+	unsigned int generation = (result != nullptr) ? result->generation : 0;
+	unsigned int pass = (result != nullptr) ? result->track_info_pass : 0;
+
+	// Skip if neither the cursor nor the compile result has changed.
+	if(editor_cache_valid && generation == editor_generation && pass == editor_pass
+		&& d.line == editor_position.line && d.column == editor_position.column)
+	{
+		editor_cache_stats.hits++;
+		return;
+	}
+	editor_cache_stats.misses++;
+	editor_cache_valid = true;
+	editor_generation = generation;
+	editor_pass = pass;
+
 	editor_position = d;
 
 	song_pos_at_cursor = UINT_MAX;
@@ -292,100 +280,35 @@ void Song_Manager::set_editor_position(const Editor_Position& d)
 	editor_refs.clear();
 	editor_jump_hack = false;
 
-	if(d.line != -1 && get_compile_result() == COMPILE_OK)
+	if(d.line != -1 && result != nullptr && result->successful)
 	{
-		// Take ownership of the song and track info pointers.
-		auto song = get_song();
-		auto lines = get_lines();
-		auto& line_map = (*lines.get())[d.line];
+		auto& cursor_index = *result->cursor_index;
+		auto& ref_pool = *result->references;
+		auto line_map = result->lines->at(d.line);
+		std::vector<Ref_Pool::Id> ref_ids;
 
 		for(auto && i : line_map)
 		{
-			Track& track = song->get_track(i.first);
-			unsigned int position = i.second;
-			unsigned int event_count = track.get_event_count();
-
 			// Disable subroutine cursor hack if we are editing a line containing a subroutine.
 			if(i.first > max_channels)
 				editor_jump_hack = true;
 
 			// Find the reference to the note adjacent to the note, and the song playtime at the
 			// beginning of the line and at the cursor.
-			if(event_count > 0)
+			auto pos = cursor_index.find(i.first, i.second, d.line, d.column);
+
+			if(pos.cursor_time < song_pos_at_cursor)
+				song_pos_at_cursor = pos.cursor_time;
+			if(pos.line_time < song_pos_at_line)
+				song_pos_at_line = pos.line_time;
+
+			// References that are not used by any Track_Info event can't be displayed.
+			// A reference used by several tracks has an id for each of them.
+			if(pos.reference != nullptr)
 			{
-				InputRef* refptr = nullptr;
-
-				// Backtrack until we find an event adjacent to the cursor
-				while(position-- > 0)
-				{
-					auto ref = track.get_event(position).reference;
-					if(ref != nullptr)
-					{
-						int line = ref->get_line(), column = ref->get_column();
-						if((line < d.line) || (line == d.line && column < d.column))
-							break;
-					}
-				}
-
-				// Select the adjacent note / rest / tie event right of the cursor
-				while(++position < event_count)
-				{
-					auto event = track.get_event(position);
-
-					if(is_note_or_jump(event.type))
-					{
-						refptr = event.reference.get();
-						if(event.play_time < song_pos_at_cursor)
-							song_pos_at_cursor = event.play_time;
-						break;
-					}
-					else if(is_loop_event(event.type))
-					{
-						break;
-					}
-				}
-
-				// Nothing was found, select the adjacent event left of cursor.
-				// Also scan for the first event at the line.
-				bool passed_line = false;
-				while((!passed_line || refptr == nullptr) && position-- > 0)
-				{
-					auto event = track.get_event(position);
-					uint32_t length = event.on_time + event.off_time;
-					InputRef* loop_refptr;
-
-					if(event.type == Event::JUMP)
-						length = get_subroutine_length(*song, event.param, 10);
-					else if(event.type == Event::LOOP_END)
-						length = get_loop_length(*song, track, position, loop_refptr, 10);
-
-					auto ref = track.get_event(position).reference;
-					if(ref != nullptr)
-					{
-						passed_line = ((signed)ref->get_line() < d.line);
-						if(!passed_line && event.play_time < song_pos_at_line)
-							song_pos_at_line = event.play_time;
-					}
-
-					if(refptr == nullptr && length != 0 && is_note_or_jump(event.type))
-					{
-						refptr = event.reference.get();
-						if((event.play_time + length) < song_pos_at_cursor)
-							song_pos_at_cursor = event.play_time + length;
-					}
-					else if(refptr == nullptr && length != 0 && event.type == Event::LOOP_END)
-					{
-						refptr = loop_refptr;
-						if((event.play_time + length) < song_pos_at_cursor)
-							song_pos_at_cursor = event.play_time + length;
-					}
-				}
-
-				if(song_pos_at_cursor < song_pos_at_line)
-					song_pos_at_line = song_pos_at_cursor;
-
-				if(refptr != nullptr)
-					editor_refs.insert(refptr);
+				ref_ids.clear();
+				ref_pool.find(pos.reference, ref_ids);
+				editor_refs.insert(ref_ids.begin(), ref_ids.end());
 			}
 		}
 	}
@@ -401,56 +324,231 @@ void Song_Manager::worker()
 	std::unique_lock<std::mutex> lock(mutex);
 	while(!worker_fired)
 	{
-		if(!job_done)
-			compile_job(lock, job_buffer, job_filename);
-		condition_variable.wait(lock);
+		if(job_pending)
+		{
+			job_pending = false;
+			compile_job(lock, std::move(job_text), job_filename, job_generation);
+		}
+		else
+		{
+			condition_variable.wait(lock);
+		}
 	}
 }
 
 //! Compile job
-void Song_Manager::compile_job(std::unique_lock<std::mutex>& lock, std::string buffer, std::string filename)
+/*!
+ *  The input lines are compared with the input of the previous compile.
+ *  If nothing has changed (for example when the file was just saved), the previous
+ *  result is kept and the song is not parsed again. Files that may be read by the
+ *  compiler, such as samples, are checked for changes as well.
+ *
+ *  Otherwise the song is parsed again from the first line. MML_Input cannot be
+ *  cloned or rebound to a different Song, and it is not known whether it keeps
+ *  state between lines outside the Song, so parsing is not resumed midway.
+ *
+ *  If a newer job has been submitted, the job stops at the next line or between
+ *  phases, without building tables or Track_Info for the partial song. Results
+ *  from a stale generation are never published.
+ *
+ *  Track_Info for long songs is generated in passes. The first pass covers the
+ *  area visible in the track view, or at least track_info_budget ticks. After
+ *  the result has been published, the rest is generated in the background,
+ *  publishing a new snapshot after each pass, until the tracks are complete or
+ *  a newer job is submitted.
+ */
+void Song_Manager::compile_job(std::unique_lock<std::mutex>& lock, std::shared_ptr<const Source_Text> text, std::string filename, unsigned int generation)
 {
+	auto start_time = job_start_time;
 	lock.unlock();
 
+	Compile_Profiler::Profile profile = {};
+	Compile_Profiler::Timer timer;
+	profile.generation = generation;
+
+	// Count a job that was stopped because a newer job was submitted. Call with the lock held.
+	auto cancel_job = [&]()
+	{
+		stats.cancelled++;
+		profile.cancelled = true;
+		Compile_Profiler::get().add(profile);
+	};
+
 	bool successful = false;
 	std::shared_ptr<InputRef> ref = nullptr;
 	std::shared_ptr<Song> temp_song = nullptr;
 	std::shared_ptr<Track_Map> temp_tracks = nullptr;
+	std::shared_ptr<Timeline_Index> temp_timeline = nullptr;
+	std::shared_ptr<Tempo_Map> temp_tempo_map = nullptr;
+	std::shared_ptr<Track_Change_Map> temp_changes = nullptr;
+	std::shared_ptr<Ref_Pool> temp_refs = nullptr;
 	std::shared_ptr<Line_Map> temp_lines = nullptr;
-	std::string str;
+	std::shared_ptr<Length_Table> temp_lengths = nullptr;
+	std::shared_ptr<Cursor_Index> temp_cursor_index = nullptr;
 	std::string message;
 	int line = 0;
 
+	// Track_Info generation state, kept for the background passes.
+	std::vector<std::pair<int, Track*>> track_list;
+	std::vector<std::unique_ptr<Track_Info_Generator>> generators;
+	unsigned int end_time = UINT_MAX;
+	bool tracks_complete = true;
+
+	// Collect the generated Track_Info into a new map. Incomplete tracks are copied,
+	// since their generators will continue. The copies share the event arrays with
+	// the generators, so the events themselves are not copied.
+	auto collect_tracks = [&]()
+	{
+		auto map = std::make_shared<Track_Map>();
+		tracks_complete = true;
+		for(auto && i : generators)
+			tracks_complete &= (i == nullptr) || i->complete;
+		for(unsigned int i = 0; i < track_list.size(); i++)
+		{
+			if(generators[i] == nullptr)
+				continue;
+			if(tracks_complete)
+				map->emplace_hint(map->end(), track_list[i].first, std::move(static_cast<Track_Info&>(*generators[i])));
+			else
+				map->emplace_hint(map->end(), track_list[i].first, static_cast<const Track_Info&>(*generators[i]));
+		}
+		return map;
+	};
+
+	unsigned int line_count = text->get_line_count();
+	profile.line_count = line_count;
+
+	std::string include_path = "";
+	int path_break = filename.find_last_of("/\\");
+	if(path_break != -1)
+		include_path = filename.substr(0, path_break + 1);
+	auto files = get_file_stamps(*text, include_path);
+
+	// Find the first line that differs from the previous successful compile.
+	int changed_line = 0;
+	if(last_valid && filename == last_filename && files == last_files)
+	{
+		unsigned int last_line_count = last_text->get_line_count();
+		unsigned int common = std::min(line_count, last_line_count);
+		while(changed_line < (int)common && text->line_equals(changed_line, *last_text, changed_line))
+			changed_line++;
+		if(changed_line == (int)common && line_count == last_line_count)
+			changed_line = -1;
+	}
+	timer.stop(profile, Compile_Profiler::PHASE_DIFF);
+
+	// A previous result with incomplete tracks can't be reused, its background passes were cancelled.
+	auto previous = get_snapshot();
+	if(changed_line == -1 && !previous->tracks_complete)
+		changed_line = line_count;
+
+	if(changed_line == -1)
+	{
+		// Input is identical, keep the previous result.
+		lock.lock();
+		profile.reused = true;
+		if(generation != job_generation)
+		{
+			cancel_job();
+			return;
+		}
+		auto result = std::make_shared<Compile_Snapshot>(*previous);
+		result->generation = generation;
+		result->first_changed_line = -1;
+		result->track_changes = std::make_shared<Track_Change_Map>();
+		result->compile_latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start_time).count();
+		profile.successful = result->successful;
+		profile.total_time = result->compile_latency;
+		std::atomic_store(&snapshot, std::shared_ptr<const Compile_Snapshot>(result));
+		stats.completed++;
+		timer.stop(profile, Compile_Profiler::PHASE_PUBLISH);
+		Compile_Profiler::get().add(profile);
+		return;
+	}
+
 	try
 	{
 		temp_song = std::make_shared<Song>();
-		temp_tracks = std::make_shared<Track_Map>();
+		temp_refs = std::make_shared<Ref_Pool>();
 		temp_lines = std::make_shared<Line_Map>();
 
-		int path_break = filename.find_last_of("/\\");
-		if(path_break != -1)
-			temp_song->add_tag("include_path", filename.substr(0, path_break + 1));
+		if(include_path.size())
+			temp_song->add_tag("include_path", include_path);
 
 		MML_Input input = MML_Input(temp_song.get());
 
 		// Read MML input line by line
-		std::stringstream stream(buffer);
-		for(; std::getline(stream, str);)
+		while(line < (int)line_count)
 		{
-			input.read_line(tabs_to_spaces(str), line);
-			temp_lines.get()->insert({line, input.get_track_map()});
+			if(is_cancelled(generation))
+				break;
+			tabs_to_spaces(text->get_line(line), text->get_line_length(line), line_buffer);
+			input.read_line(line_buffer, line);
+			timer.stop(profile, Compile_Profiler::PHASE_PARSE);
+			temp_lines->insert(line, input.get_track_map());
+			timer.stop(profile, Compile_Profiler::PHASE_LINE_MAP);
 			line++;
 		}
+		profile.parsed_lines = line;
+		if(is_cancelled(generation))
+		{
+			lock.lock();
+			cancel_job();
+			return;
+		}
 
-		// Generate track note lists.
+		// Precalculate subroutine and loop lengths and the event index for the editor cursor.
+		temp_lengths = std::make_shared<Length_Table>(*temp_song);
+		temp_cursor_index = std::make_shared<Cursor_Index>(*temp_song, *temp_lengths);
+		timer.stop(profile, Compile_Profiler::PHASE_TABLES);
+		if(is_cancelled(generation))
+		{
+			lock.lock();
+			cancel_job();
+			return;
+		}
+
+		// Generate track note lists. Each track is independent, so this is done in parallel.
 		for(auto it = temp_song->get_track_map().begin(); it != temp_song->get_track_map().end(); it++)
 		{
+			profile.track_count++;
+			profile.event_count += it->second.get_event_count();
 			// TODO: Max track count should be decided based on the target platform.
 			if(it->first < max_channels)
-				temp_tracks->emplace_hint(temp_tracks->end(),
-					std::make_pair(it->first, Track_Info_Generator(*temp_song, it->second)));
+				track_list.push_back(std::make_pair(it->first, &it->second));
 		}
 
+		// Allocations on the calling thread are counted by the timer.
+		auto caller_id = std::this_thread::get_id();
+		std::atomic<uint64_t> pool_allocations(0);
+		if(track_info_budget)
+			end_time = std::max(track_info_budget, view_end.load());
+		generators.resize(track_list.size());
+		Thread_Pool::get().run(track_list.size(), [&](unsigned int index)
+		{
+			auto allocations = Compile_Profiler::get_thread_allocations();
+			if(!is_cancelled(generation))
+				generators[index] = std::make_unique<Track_Info_Generator>(*temp_song, *track_list[index].second, *temp_refs, end_time);
+			if(std::this_thread::get_id() != caller_id)
+				pool_allocations += Compile_Profiler::get_thread_allocations() - allocations;
+		});
+		if(is_cancelled(generation))
+		{
+			lock.lock();
+			cancel_job();
+			return;
+		}
+
+		temp_tracks = collect_tracks();
+		temp_timeline = std::make_shared<Timeline_Index>(*temp_tracks);
+		temp_tempo_map = std::make_shared<Tempo_Map>(*temp_tracks, temp_song->get_ppqn());
+		if(previous != nullptr && previous->tracks != nullptr)
+			temp_changes = compare_tracks(*previous->tracks, *temp_tracks);
+
+		timer.stop(profile, Compile_Profiler::PHASE_TRACK_INFO);
+		profile.allocations[Compile_Profiler::PHASE_TRACK_INFO] += pool_allocations;
+
 		successful = true;
 		message = "";
 	}
@@ -461,30 +559,214 @@ void Song_Manager::compile_job(std::unique_lock<std::mutex>& lock, std::string b
 	}
 	catch (std::exception& except)
 	{
+		std::string str = (line < (int)line_count) ? text->get_line_string(line) : "";
 		ref = std::make_shared<InputRef>("", str, line, 0);
 		message = "Exception: " + std::string(except.what());
 	}
 
+	// Restart the timer here, the time spent on a failed phase is not counted.
+	timer.restart();
+	profile.successful = successful;
+
 	lock.lock();
-	job_done = true;
-	job_successful = successful;
-	song = temp_song;
-	tracks = temp_tracks;
-	lines = temp_lines;
-	error_message = message;
-	error_reference = ref;
+	if(generation != job_generation)
+	{
+		// Discard the result, a newer job is waiting.
+		cancel_job();
+		return;
+	}
+
+	last_text = std::move(text);
+	last_filename = filename;
+	last_files = std::move(files);
+	last_valid = successful;
+
+	auto result = std::make_shared<Compile_Snapshot>();
+	result->generation = generation;
+	result->successful = successful;
+	result->song = temp_song;
+	result->tracks = temp_tracks;
+	result->tracks_complete = !successful || tracks_complete;
+	result->track_info_pass = 0;
+	result->timeline = temp_timeline;
+	result->tempo_map = temp_tempo_map;
+	result->track_changes = temp_changes;
+	result->references = temp_refs;
+	result->lines = temp_lines;
+	result->lengths = temp_lengths;
+	result->cursor_index = temp_cursor_index;
+	result->error_message = message;
+	result->error_reference = ref;
+	result->first_changed_line = changed_line;
+	result->track_info_time = profile.time[Compile_Profiler::PHASE_TRACK_INFO];
+	result->compile_latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start_time).count();
+	profile.total_time = result->compile_latency;
+	std::atomic_store(&snapshot, std::shared_ptr<const Compile_Snapshot>(result));
+	stats.completed++;
+	timer.stop(profile, Compile_Profiler::PHASE_PUBLISH);
+
+	// Generate the rest of the Track_Info in the background.
+	auto background_start_time = std::chrono::steady_clock::now();
+	while(successful && !tracks_complete)
+	{
+		lock.unlock();
+
+		std::shared_ptr<Track_Map> pass_tracks = nullptr;
+		std::shared_ptr<Timeline_Index> pass_timeline = nullptr;
+		std::shared_ptr<Tempo_Map> pass_tempo_map = nullptr;
+		std::shared_ptr<Track_Change_Map> pass_changes = nullptr;
+		try
+		{
+			// A pass only adds events at the end of the incomplete tracks.
+			pass_changes = std::make_shared<Track_Change_Map>();
+			for(unsigned int i = 0; i < generators.size(); i++)
+			{
+				if(generators[i] != nullptr && !generators[i]->complete)
+					pass_changes->emplace_hint(pass_changes->end(), track_list[i].first, Track_Change{(int)generators[i]->length, INT_MAX});
+			}
+
+			end_time = (end_time < UINT_MAX - track_info_budget) ? end_time + track_info_budget : UINT_MAX;
+			end_time = std::max(end_time, view_end.load());
+			Thread_Pool::get().run(generators.size(), [&](unsigned int index)
+			{
+				auto& generator = generators[index];
+				if(generator != nullptr && !generator->complete && !is_cancelled(generation))
+					generator->generate(end_time);
+			});
+			if(is_cancelled(generation))
+			{
+				lock.lock();
+				break;
+			}
+			pass_tracks = collect_tracks();
+			pass_timeline = std::make_shared<Timeline_Index>(*temp_timeline, *pass_tracks);
+			pass_tempo_map = temp_tempo_map->is_current(*pass_tracks)
+				? temp_tempo_map
+				: std::make_shared<Tempo_Map>(*pass_tracks, temp_song->get_ppqn());
+		}
+		catch (InputError& error)
+		{
+			ref = error.get_reference();
+			message = error.what();
+		}
+		catch (std::exception& except)
+		{
+			ref = nullptr;
+			message = "Exception: " + std::string(except.what());
+		}
+
+		lock.lock();
+		if(generation != job_generation)
+			break;
+
+		auto pass_result = std::make_shared<Compile_Snapshot>(*get_snapshot());
+		if(pass_tracks != nullptr)
+		{
+			pass_result->tracks = pass_tracks;
+			pass_result->timeline = pass_timeline;
+			pass_result->tempo_map = pass_tempo_map;
+			pass_result->track_changes = pass_changes;
+			temp_timeline = pass_timeline;
+			temp_tempo_map = pass_tempo_map;
+			pass_result->tracks_complete = tracks_complete;
+			pass_result->track_info_pass++;
+		}
+		else
+		{
+			// Validation errors in the rest of the track make the compile fail.
+			successful = false;
+			last_valid = false;
+			pass_result->successful = false;
+			pass_result->tracks_complete = true;
+			pass_result->error_message = message;
+			pass_result->error_reference = ref;
+			pass_result->track_changes = nullptr;
+		}
+		std::atomic_store(&snapshot, std::shared_ptr<const Compile_Snapshot>(pass_result));
+		profile.background_passes++;
+	}
+	if(profile.background_passes)
+	{
+		profile.background_time = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - background_start_time).count();
+	}
+	Compile_Profiler::get().add(profile);
+}
+
+//! Find the changed song positions of each track.
+/*!
+ *  Tracks that were added or removed are changed from the start.
+ *  Unchanged tracks are not included in the result.
+ */
+std::shared_ptr<Song_Manager::Track_Change_Map> Song_Manager::compare_tracks(const Track_Map& old_tracks, const Track_Map& new_tracks)
+{
+	auto changes = std::make_shared<Track_Change_Map>();
+	for(auto && i : new_tracks)
+	{
+		auto it = old_tracks.find(i.first);
+		Track_Change change = {0, INT_MAX};
+		if(it == old_tracks.end() || it->second.compare(i.second, change.start, change.end))
+			changes->emplace_hint(changes->end(), i.first, change);
+	}
+	for(auto && i : old_tracks)
+	{
+		if(!new_tracks.count(i.first))
+			changes->emplace(i.first, Track_Change{0, INT_MAX});
+	}
+	return changes;
+}
+
+//! Get the size and modification time of all files that may be read when compiling.
+/*!
+ *  Every quoted string in the text is treated as a file name relative to
+ *  the include path. Strings that are not file names are recorded as
+ *  missing files, so that a file that is created later is also detected.
+ */
+Song_Manager::File_Stamp_List Song_Manager::get_file_stamps(const Source_Text& text, const std::string& include_path)
+{
+	File_Stamp_List files;
+	const std::string& str = text.get_text();
+	std::string::size_type start = str.find('"');
+	while(start != std::string::npos)
+	{
+		auto end = str.find_first_of("\"\n", start + 1);
+		if(end == std::string::npos)
+			break;
+		if(str[end] != '"')
+		{
+			// unterminated string
+			start = str.find('"', end + 1);
+			continue;
+		}
+		std::string filename = str.substr(start + 1, end - start - 1);
+		if(filename.empty() || (filename[0] != '/' && filename[0] != '\\' && filename.find(':') == std::string::npos))
+			filename = include_path + filename;
+		start = str.find('"', end + 1);
+
+		struct stat info;
+		if(stat(filename.c_str(), &info) == 0)
+			files.push_back({filename, (long long)info.st_size, (long long)info.st_mtime});
+		else
+			files.push_back({filename, -1, 0});
+	}
+	return files;
 }
 
 //! Convert all tabs to spaces in a string.
 /*!
  *  Currently tabstop is hardcoded to 4 to match the editor.
+ *
+ *  The output is written to a buffer that is reused between calls, so that
+ *  no allocation is needed once it has grown to the longest line.
  */
-std::string Song_Manager::tabs_to_spaces(const std::string& str) const
+void Song_Manager::tabs_to_spaces(const char* str, std::size_t length, std::string& out)
 {
 	const unsigned int tabstop = 4;
-	std::string out = "";
-	for(char i : str)
+	out.clear();
+	for(const char* end = str + length; str != end; str++)
 	{
+		char i = *str;
 		if(i == '\t')
 		{
 			do
@@ -498,7 +780,6 @@ std::string Song_Manager::tabs_to_spaces(const std::string& str) const
 			out.push_back(i);
 		}
 	}
-	return out;
 }
 
 std::pair<int16_t,uint32_t> Song_Manager::get_channel(uint16_t track) const
@@ -542,13 +823,7 @@ void Song_Manager::toggle_solo(uint16_t track_id)
 		}
 		else
 		{
-			for(auto && i : mute_mask)
-			{
-				if(i.first == channel.first)
-					i.second = ~channel.second;
-				else if(i.first != channel.first)
-					i.second = 0xffffffff;
-			}
+			mute_mask = get_solo_mask(track_id);
 			update_mute();
 		}
 	}
@@ -568,19 +843,26 @@ bool Song_Manager::get_mute(uint16_t track_id) const
 bool Song_Manager::get_solo(uint16_t track_id) const
 {
 	auto channel = get_channel(track_id);
-	bool is_solo = false;
+	return channel.first >= 0 && mute_mask == get_solo_mask(track_id);
+}
+
+//! Get the mute mask that plays only the channel of a track.
+/*!
+ *  Tracks that share the channel are also heard.
+ *
+ *  \return an empty map if the track has no channel.
+ */
+std::map<int16_t,uint32_t> Song_Manager::get_solo_mask(uint16_t track_id) const
+{
+	std::map<int16_t,uint32_t> mask;
+	auto channel = get_channel(track_id);
 	if(channel.first >= 0)
 	{
-		is_solo = true;
-		for(auto && i : mute_mask)
-		{
-			if(i.first == channel.first && i.second != (uint32_t)~channel.second)
-				is_solo = false;
-			else if(i.first != channel.first && i.second != 0xffffffff)
-				is_solo = false;
-		}
+		for(auto && i : track_channel_table)
+			mask[i.second.first] = 0xffffffff;
+		mask[channel.first] = ~channel.second;
 	}
-	return is_solo;
+	return mask;
 }
 
 void Song_Manager::reset_mute()
@@ -592,6 +874,8 @@ void Song_Manager::reset_mute()
 
 void Song_Manager::update_mute()
 {
+	// The player keeps the latest mask of each chip until the audio
+	// thread applies it, so nothing needs to be sent again later.
 	if(player)
 		player->set_mute_mask(mute_mask);
 }
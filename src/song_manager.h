@@ -4,10 +4,13 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 #include <memory>
 #include <unordered_set>
 #include <set>
 #include <map>
+#include <vector>
+#include <chrono>
 
 #include "core.h"
 #include "song.h"
@@ -16,8 +19,15 @@
 
 #include "audio_manager.h"
 #include "emu_player.h"
+#include "line_map.h"
+#include "ref_pool.h"
 
 struct Track_Info;
+class Length_Table;
+class Cursor_Index;
+class Timeline_Index;
+class Tempo_Map;
+class Source_Text;
 
 class Song_Manager
 {
@@ -30,8 +40,15 @@ class Song_Manager
 		};
 
 		typedef std::map<int, Track_Info> Track_Map;
-		typedef std::map<int, MML_Input::Track_Position_Map> Line_Map;
-		typedef std::set<InputRef*> Ref_Ptr_Set;
+		typedef std::set<Ref_Pool::Id> Ref_Id_Set;
+
+		//! Song positions where a track changed since the previous snapshot.
+		struct Track_Change
+		{
+			int start;			// first changed tick
+			int end;			// end of the changed ticks (exclusive), INT_MAX if the rest of the track changed
+		};
+		typedef std::map<int, Track_Change> Track_Change_Map;
 
 		typedef struct
 		{
@@ -39,29 +56,89 @@ class Song_Manager
 			int column;
 		} Editor_Position;
 
+		//! Immutable result of a compile job.
+		/*!
+		 *  A new snapshot is published atomically after each compile, so all
+		 *  data from a snapshot always belongs to the same compile.
+		 */
+		struct Compile_Snapshot
+		{
+			unsigned int generation;			// compile request that produced this snapshot
+			bool successful;
+			std::shared_ptr<Song> song;
+			std::shared_ptr<Track_Map> tracks;
+			bool tracks_complete;				// false if Track_Info is still being generated in the background
+			unsigned int track_info_pass;		// incremented each time more Track_Info is published
+			std::shared_ptr<Timeline_Index> timeline;	// notes of all tracks by song position
+			std::shared_ptr<Tempo_Map> tempo_map;		// song position to seconds
+			std::shared_ptr<Track_Change_Map> track_changes;	// changed tracks since the previous snapshot, nullptr if all changed
+			std::shared_ptr<Ref_Pool> references;	// references used by the Track_Info events
+			std::shared_ptr<Line_Map> lines;
+			std::shared_ptr<Length_Table> lengths;
+			std::shared_ptr<Cursor_Index> cursor_index;
+			std::string error_message;
+			std::shared_ptr<InputRef> error_reference;
+
+			unsigned int compile_latency;		// time from request to result, in microseconds
+			unsigned int track_info_time;		// time spent generating Track_Info, in microseconds
+			int first_changed_line;				// -1 if the previous result was reused
+		};
+
+		//! Compile scheduler statistics
+		struct Compile_Stats
+		{
+			unsigned int submitted;		// compile requests
+			unsigned int superseded;	// requests replaced before the worker picked them up
+			unsigned int cancelled;		// jobs aborted or discarded because a newer request arrived
+			unsigned int completed;		// jobs whose result was published
+		};
+
+		//! Editor position cache statistics
+		struct Editor_Cache_Stats
+		{
+			unsigned int hits;			// set_editor_position calls that reused the previous result
+			unsigned int misses;		// set_editor_position calls that resolved the position
+		};
+
 		Song_Manager();
 		virtual ~Song_Manager();
 
-		Compile_Result get_compile_result();
-		bool get_compile_in_progress();
+		Compile_Result get_compile_result() const;
+		bool get_compile_in_progress() const;
 
-		int compile(const std::string& buffer, const std::string& filename);
+		int compile(std::shared_ptr<const Source_Text> text, const std::string& filename);
 		void play(uint32_t start_position = 0);
 		void stop();
 
-		std::shared_ptr<Song> get_song();
+		std::shared_ptr<const Compile_Snapshot> get_snapshot() const;
+		std::shared_ptr<Song> get_song() const;
 		std::shared_ptr<Emu_Player> get_player();
-		std::shared_ptr<Track_Map> get_tracks();
-		std::shared_ptr<Line_Map> get_lines();
-		std::string get_error_message();
+		std::shared_ptr<Track_Map> get_tracks() const;
+		std::shared_ptr<Line_Map> get_lines() const;
+		std::string get_error_message() const;
+		Compile_Stats get_compile_stats();
+
+		void set_view_end(unsigned int ticks);
+		static void set_track_info_budget(unsigned int ticks);
+		static void tabs_to_spaces(const char* str, std::size_t length, std::string& out);
 
 		void set_editor_position(const Editor_Position& d);
 
+		//! Get the editor position cache statistics.
+		inline const Editor_Cache_Stats& get_editor_cache_stats() const { return editor_cache_stats; }
+
 		//! Get the current editor position. Used to display cursors.
 		inline const Editor_Position& get_editor_position() const { return editor_position; }
 
-		//! Get a set of references pointers at the editor position. Note that the pointers may be invalid.
-		inline const Ref_Ptr_Set& get_editor_refs() const { return editor_refs; }
+		//! Get a set of reference ids at the editor position.
+		/*!
+		 *  The ids belong to the Ref_Pool of the snapshot with the generation
+		 *  returned by get_editor_generation().
+		 */
+		inline const Ref_Id_Set& get_editor_refs() const { return editor_refs; }
+
+		//! Get the compile generation that the editor position was resolved for.
+		inline unsigned int get_editor_generation() const { return editor_generation; }
 
 		//! Return true if editor position points to a subroutine. Used to enable a hack.
 		inline bool get_editor_subroutine() const { return editor_jump_hack; }
@@ -79,17 +156,35 @@ class Song_Manager
 
 		bool get_mute(uint16_t track_id) const;
 		bool get_solo(uint16_t track_id) const;
+		std::map<int16_t,uint32_t> get_solo_mask(uint16_t track_id) const;
 
 		void reset_mute();
 
 	private:
+		//! Size and modification time of a file that may be read by the compiler.
+		struct File_Stamp
+		{
+			std::string filename;
+			long long size;				// -1 if the file does not exist
+			long long modified;
+
+			inline bool operator==(const File_Stamp& other) const
+			{
+				return filename == other.filename && size == other.size && modified == other.modified;
+			}
+		};
+		typedef std::vector<File_Stamp> File_Stamp_List;
+
 		void worker();
-		void compile_job(std::unique_lock<std::mutex>& lock, std::string buffer, std::string filename);
-		std::string tabs_to_spaces(const std::string& str) const;
+		void compile_job(std::unique_lock<std::mutex>& lock, std::shared_ptr<const Source_Text> text, std::string filename, unsigned int generation);
+		inline bool is_cancelled(unsigned int generation) const { return generation != latest_generation.load(); }
+		static std::shared_ptr<Track_Change_Map> compare_tracks(const Track_Map& old_tracks, const Track_Map& new_tracks);
+		static File_Stamp_List get_file_stamps(const Source_Text& text, const std::string& include_path);
 		void update_mute();
 
 		// song status
 		const static int max_channels;
+		static unsigned int track_info_budget;
 
 		// worker state
 		std::mutex mutex;
@@ -98,31 +193,44 @@ class Song_Manager
 
 		// worker status
 		bool worker_fired;	// set to 1 to kill worker thread
-		bool job_done;		// set to 0 to begin compile
-		bool job_successful;
+		bool job_pending;	// set to 1 when a new job is waiting for the worker
+		Compile_Stats stats;
 
 		// worker input
-		std::string job_buffer;
+		std::shared_ptr<const Source_Text> job_text;
 		std::string job_filename;
+		std::chrono::steady_clock::time_point job_start_time;
+		unsigned int job_generation;
+		std::atomic<unsigned int> latest_generation; // checked by the worker to cancel stale jobs
+		std::atomic<unsigned int> view_end; // end of the visible area in the track view, in ticks
 
-		// worker output
-		std::shared_ptr<Song> song;
-		std::shared_ptr<Track_Map> tracks;
-		std::shared_ptr<Line_Map> lines;
-		std::string error_message;
-		std::shared_ptr<InputRef> error_reference;
+		// previous compile input (only accessed by the worker)
+		std::shared_ptr<const Source_Text> last_text;
+		std::string last_filename;
+		File_Stamp_List last_files;
+		bool last_valid;
+		std::string line_buffer; // scratch buffer for tab expansion, reused between lines and jobs
+
+		// worker output. Only access using std::atomic_load/std::atomic_store.
+		std::shared_ptr<const Compile_Snapshot> snapshot;
 
 		// playback state
 		std::shared_ptr<Emu_Player> player;
 
 		// editor state
 		Editor_Position editor_position;
-		Ref_Ptr_Set editor_refs;
+		Ref_Id_Set editor_refs;
 		bool editor_jump_hack;
 
 		unsigned int song_pos_at_line;
 		unsigned int song_pos_at_cursor;
 
+		// editor position cache. The result above is valid for this compile generation.
+		bool editor_cache_valid;
+		unsigned int editor_generation;
+		unsigned int editor_pass;
+		Editor_Cache_Stats editor_cache_stats;
+
 		// muting
 		std::map<int16_t, uint32_t> mute_mask; // Chip_id, channel_id
 		const static std::map<uint16_t, std::pair<int16_t, uint32_t>> track_channel_table; // Track to channel ID table
@@ -0,0 +1,52 @@
+#include "source_text.h"
+
+#include <algorithm>
+#include <cstring>
+
+//! Take ownership of a text buffer.
+Source_Text::Source_Text(std::string&& text)
+	: text(std::move(text))
+{
+	split();
+}
+
+//! Copy a text buffer.
+Source_Text::Source_Text(const std::string& text)
+	: text(text)
+{
+	split();
+}
+
+//! Get a copy of a line.
+std::string Source_Text::get_line_string(unsigned int line) const
+{
+	return std::string(get_line(line), get_line_length(line));
+}
+
+//! Compare a line with a line from another text.
+bool Source_Text::line_equals(unsigned int line, const Source_Text& other, unsigned int other_line) const
+{
+	std::size_t length = get_line_length(line);
+	return length == other.get_line_length(other_line)
+		&& !std::memcmp(get_line(line), other.get_line(other_line), length);
+}
+
+//! Split the text into lines.
+/*!
+ *  Behaves like reading the buffer with std::getline. The line array is
+ *  allocated once, after counting the lines.
+ */
+void Source_Text::split()
+{
+	lines.reserve(std::count(text.begin(), text.end(), '\n') + 1);
+
+	std::string::size_type pos = 0;
+	while(pos < text.size())
+	{
+		auto end = text.find('\n', pos);
+		if(end == std::string::npos)
+			end = text.size();
+		lines.push_back({pos, end - pos});
+		pos = end + 1;
+	}
+}
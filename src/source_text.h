@@ -0,0 +1,49 @@
+#ifndef SOURCE_TEXT_H
+#define SOURCE_TEXT_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//! Immutable MML source text, split into lines.
+/*!
+ *  The editor text is moved into this object once and then shared by
+ *  std::shared_ptr<const Source_Text> between the editor and the compile
+ *  worker. Lines are stored as ranges into the text, so splitting does
+ *  not allocate a string per line.
+ */
+class Source_Text
+{
+	public:
+		Source_Text(std::string&& text);
+		Source_Text(const std::string& text);
+
+		//! Get the number of lines.
+		inline unsigned int get_line_count() const { return lines.size(); }
+
+		//! Get a pointer to the start of a line. The line is not null terminated.
+		inline const char* get_line(unsigned int line) const { return text.data() + lines[line].offset; }
+
+		//! Get the length of a line.
+		inline std::size_t get_line_length(unsigned int line) const { return lines[line].length; }
+
+		//! Get the entire text.
+		inline const std::string& get_text() const { return text; }
+
+		std::string get_line_string(unsigned int line) const;
+		bool line_equals(unsigned int line, const Source_Text& other, unsigned int other_line) const;
+
+	private:
+		struct Line
+		{
+			std::size_t offset;
+			std::size_t length;
+		};
+
+		void split();
+
+		std::string text;
+		std::vector<Line> lines;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+
+//! Fixed size, lock-free single producer, single consumer queue.
+/*!
+ *  push() must only be called from one thread and pop() from one other
+ *  thread. Neither allocates or blocks, so either side can be used from
+ *  the audio thread.
+ */
+template<class T>
+class Spsc_Queue
+{
+	public:
+		//! Create a queue. All memory is allocated here.
+		Spsc_Queue(std::size_t capacity)
+			: buffer(capacity + 1)
+			, head(0)
+			, tail(0)
+		{}
+
+		//! Add an item to the queue (producer side).
+		/*!
+		 *  \return false if the queue is full. \p value is not moved from in this case.
+		 */
+		bool push(T&& value)
+		{
+			std::size_t pos = tail.load(std::memory_order_relaxed);
+			std::size_t next = increment(pos);
+			if(next == head.load(std::memory_order_acquire))
+				return false;
+			buffer[pos] = std::move(value);
+			tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		//! Remove an item from the queue (consumer side).
+		/*!
+		 *  \return false if the queue is empty.
+		 */
+		bool pop(T& value)
+		{
+			std::size_t pos = head.load(std::memory_order_relaxed);
+			if(pos == tail.load(std::memory_order_acquire))
+				return false;
+			value = std::move(buffer[pos]);
+			head.store(increment(pos), std::memory_order_release);
+			return true;
+		}
+
+		inline std::size_t capacity() const { return buffer.size() - 1; }
+
+	private:
+		inline std::size_t increment(std::size_t pos) const
+		{
+			return (pos + 1 == buffer.size()) ? 0 : pos + 1;
+		}
+
+		std::vector<T> buffer;
+		std::atomic<std::size_t> head;		// next item to pop, written by the consumer
+		std::atomic<std::size_t> tail;		// next free slot, written by the producer
+};
+
+#endif
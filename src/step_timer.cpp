@@ -0,0 +1,54 @@
+#include "step_timer.h"
+
+#include <cmath>
+
+Step_Timer::Step_Timer()
+	: sample_rate(1)
+	, delta(0)
+	, sample_count(0)
+	, step_count(0)
+{
+}
+
+//! Set the output sample rate. This also resets the schedule.
+void Step_Timer::set_sample_rate(uint32_t rate)
+{
+	sample_rate = rate ? rate : 1;
+	delta = 0;
+	sample_count = 0;
+	step_count = 0;
+}
+
+//! Add the length of the next step.
+/*!
+ *  The length is rounded to the nearest 1/2^32 of a sample. Steps that
+ *  are not positive are treated as one sample long, so that a stopped
+ *  driver can't stall the output.
+ */
+void Step_Timer::add_step(double seconds)
+{
+	int64_t length = std::llround(std::ldexp(seconds * sample_rate, fraction_bits));
+	if(length <= 0)
+		length = int64_t(1) << fraction_bits;
+	delta -= length;
+	step_count++;
+}
+
+//! Advance the time by a number of output samples.
+void Step_Timer::advance(uint32_t samples)
+{
+	delta += int64_t(samples) << fraction_bits;
+	sample_count += samples;
+}
+
+//! Get the number of samples that can be advanced before the next step is due.
+/*!
+ *  \return at most \p max_samples. 0 if a step is already due.
+ */
+uint32_t Step_Timer::get_idle_samples(uint32_t max_samples) const
+{
+	if(delta > 0)
+		return 0;
+	uint64_t idle = uint64_t(-delta) >> fraction_bits;
+	return (idle < max_samples) ? idle : max_samples;
+}
@@ -0,0 +1,42 @@
+#ifndef STEP_TIMER_H
+#define STEP_TIMER_H
+
+#include <cstdint>
+
+//! Schedules driver steps on output samples.
+/*!
+ *  Time is kept in fixed point with 32 fractional bits, in units of
+ *  output samples. Each step length is converted once when it is added,
+ *  after that the schedule only uses integer arithmetic, so it does not
+ *  drift and gives the same result on every run.
+ *
+ *  The timer counts the time until the next step. A step is due when
+ *  the time has passed, then the length of the next step is added.
+ */
+class Step_Timer
+{
+	public:
+		Step_Timer();
+
+		void set_sample_rate(uint32_t rate);
+		void add_step(double seconds);
+		void advance(uint32_t samples);
+		uint32_t get_idle_samples(uint32_t max_samples) const;
+
+		//! Check if a step is due.
+		inline bool step_due() const { return delta > 0; }
+
+		inline uint32_t get_sample_rate() const { return sample_rate; }
+		inline uint64_t get_sample_count() const { return sample_count; }
+		inline uint64_t get_step_count() const { return step_count; }
+
+		const static int fraction_bits = 32;
+
+	private:
+		uint32_t sample_rate;
+		int64_t delta;				// time after the next step, negative until the step is due
+		uint64_t sample_count;		// samples since the sample rate was set
+		uint64_t step_count;		// steps since the sample rate was set
+};
+
+#endif
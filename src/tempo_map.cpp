@@ -0,0 +1,130 @@
+#include "tempo_map.h"
+
+#include <algorithm>
+
+// Tempo before the first tempo command
+const double Tempo_Map::default_bpm = 120.0;
+
+//! Generate the tempo map for all tracks in a song.
+/*!
+ *  \param ppqn Ticks per quarter note, from the Song.
+ */
+Tempo_Map::Tempo_Map(const std::map<int, Track_Info>& tracks, unsigned int ppqn)
+	: ppqn(ppqn)
+{
+	get_source(tracks, source_event_count, source_repeat_end);
+
+	int end = 0;
+	for(auto && i : tracks)
+		end = std::max(end, (int)i.second.length);
+
+	std::vector<Track_Info::Tempo_Event> tempo_events;
+	for(auto && i : tracks)
+	{
+		const Track_Info& info = i.second;
+		tempo_events.insert(tempo_events.end(), info.tempo_events.begin(), info.tempo_events.end());
+
+		// Repeat the tempo commands in the loop section up to the end of the longest track.
+		if(!info.loop_length || info.loop_start < 0)
+			continue;
+		auto loop_begin = std::lower_bound(info.tempo_events.begin(), info.tempo_events.end(), info.loop_start,
+			[](const Track_Info::Tempo_Event& e, int time) { return e.time < time; });
+		if(loop_begin == info.tempo_events.end())
+			continue;
+		for(int offset = info.loop_length; info.loop_start + offset < end; offset += info.loop_length)
+		{
+			for(auto it = loop_begin; it != info.tempo_events.end() && it->time + offset < end; it++)
+				tempo_events.push_back({it->time + offset, it->bpm});
+		}
+	}
+
+	// Commands at the same position are applied in track order.
+	std::stable_sort(tempo_events.begin(), tempo_events.end(),
+		[](const Track_Info::Tempo_Event& a, const Track_Info::Tempo_Event& b) { return a.time < b.time; });
+
+	add_segment(0, default_bpm);
+	for(auto && i : tempo_events)
+		add_segment(i.time, i.bpm);
+}
+
+//! Check if the map is the same as one generated from \p tracks.
+/*!
+ *  \p tracks must be the tracks the map was generated from, or a later
+ *  Track_Info pass of them. Only the number of tempo commands and the end
+ *  of the repeated loop sections are compared, since a later pass only
+ *  adds events at the end of each track.
+ */
+bool Tempo_Map::is_current(const std::map<int, Track_Info>& tracks) const
+{
+	std::size_t event_count;
+	int repeat_end;
+	get_source(tracks, event_count, repeat_end);
+	return event_count == source_event_count && repeat_end == source_repeat_end;
+}
+
+//! Get the number of tempo commands in the tracks, and the end of the repeated loop sections.
+void Tempo_Map::get_source(const std::map<int, Track_Info>& tracks, std::size_t& event_count, int& repeat_end)
+{
+	int end = 0;
+	bool repeat = false;
+	event_count = 0;
+	for(auto && i : tracks)
+	{
+		const Track_Info& info = i.second;
+		end = std::max(end, (int)info.length);
+		event_count += info.tempo_events.size();
+		if(info.loop_length && info.loop_start >= 0
+			&& info.tempo_events.size() && info.tempo_events.back().time >= info.loop_start)
+			repeat = true;
+	}
+	repeat_end = repeat ? end : -1;
+}
+
+//! Convert a song position to seconds.
+double Tempo_Map::get_seconds(double ticks) const
+{
+	std::size_t i = std::upper_bound(start_ticks.begin(), start_ticks.end(), ticks) - start_ticks.begin();
+	if(i > 0)
+		i--;
+	return start_seconds[i] + (ticks - start_ticks[i]) * 60.0 / (segment_bpm[i] * ppqn);
+}
+
+//! Convert seconds to a song position.
+double Tempo_Map::get_ticks(double seconds) const
+{
+	std::size_t i = std::upper_bound(start_seconds.begin(), start_seconds.end(), seconds) - start_seconds.begin();
+	if(i > 0)
+		i--;
+	return start_ticks[i] + (seconds - start_seconds[i]) * segment_bpm[i] * ppqn / 60.0;
+}
+
+//! Get the tempo at a song position.
+double Tempo_Map::get_bpm(double ticks) const
+{
+	std::size_t i = std::upper_bound(start_ticks.begin(), start_ticks.end(), ticks) - start_ticks.begin();
+	return segment_bpm[(i > 0) ? i - 1 : 0];
+}
+
+//! Start a new segment. Positions must be added in increasing order.
+void Tempo_Map::add_segment(int ticks, double bpm)
+{
+	if(bpm <= 0)
+		return;
+
+	if(start_ticks.size())
+	{
+		// Replace the tempo of a segment starting at the same position
+		if(start_ticks.back() == ticks)
+		{
+			segment_bpm.back() = bpm;
+			return;
+		}
+		if(segment_bpm.back() == bpm)
+			return;
+	}
+
+	double seconds = start_ticks.size() ? get_seconds(ticks) : 0.0;
+	start_ticks.push_back(ticks);
+	start_seconds.push_back(seconds);
+	segment_bpm.push_back(bpm);
+}
@@ -0,0 +1,57 @@
+#ifndef TEMPO_MAP_H
+#define TEMPO_MAP_H
+
+#include <vector>
+#include <map>
+
+#include "track_info.h"
+
+//! Conversion between song positions in ticks and time in seconds.
+/*!
+ *  This is generated once per compile from the tempo commands in the
+ *  Track_Info of every track. A tempo command applies to the entire song
+ *  from its play time. The map is a list of segments with a constant
+ *  tempo, so each conversion is a binary search followed by a linear
+ *  interpolation.
+ *
+ *  Tempo commands in loop sections are repeated up to the end of the
+ *  longest track. After the last tempo change, the tempo stays constant.
+ *
+ *  Only BPM tempo commands are supported. Platform specific timer
+ *  values are ignored.
+ *
+ *  When Track_Info is generated in several passes, is_current() checks if
+ *  the map of the previous pass can be kept.
+ */
+class Tempo_Map
+{
+	public:
+		Tempo_Map(const std::map<int, Track_Info>& tracks, unsigned int ppqn);
+
+		double get_seconds(double ticks) const;
+		double get_ticks(double seconds) const;
+		double get_bpm(double ticks) const;
+
+		inline std::size_t size() const { return start_ticks.size(); }
+
+		bool is_current(const std::map<int, Track_Info>& tracks) const;
+
+		const static double default_bpm;
+
+	private:
+		void add_segment(int ticks, double bpm);
+		static void get_source(const std::map<int, Track_Info>& tracks, std::size_t& event_count, int& repeat_end);
+
+		double ppqn;
+
+		// Tempo commands the map was generated from.
+		std::size_t source_event_count;
+		int source_repeat_end;				// end of the repeated loop sections, -1 if none
+
+		// Segments with constant tempo, sorted by start position.
+		std::vector<int> start_ticks;
+		std::vector<double> start_seconds;
+		std::vector<double> segment_bpm;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "thread_pool.h"
+
+unsigned int Thread_Pool::default_thread_count = 0;
+
+//! Construct a thread pool.
+/*!
+ *  \param thread_count Total number of threads, including the thread calling run().
+ *                      If zero, the hardware concurrency is used.
+ */
+Thread_Pool::Thread_Pool(unsigned int thread_count)
+	: job(nullptr)
+	, errors(nullptr)
+	, next_index(0)
+	, job_count(0)
+	, remaining(0)
+	, quit(false)
+{
+	if(thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+	for(unsigned int i = 1; i < thread_count; i++)
+		threads.emplace_back(&Thread_Pool::worker, this);
+}
+
+Thread_Pool::~Thread_Pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		quit = true;
+	}
+	work_cv.notify_all();
+	for(auto && i : threads)
+		i.join();
+}
+
+//! Get the shared thread pool instance.
+Thread_Pool& Thread_Pool::get()
+{
+	static Thread_Pool instance(default_thread_count);
+	return instance;
+}
+
+//! Set the thread count of the shared instance.
+/*!
+ *  Must be called before the first call to get(). Zero means hardware concurrency.
+ */
+void Thread_Pool::set_default_thread_count(unsigned int count)
+{
+	default_thread_count = count;
+}
+
+//! Run a job for each index from 0 to count - 1, and wait for all of them to finish.
+/*!
+ *  \exception std::exception If any jobs threw an exception, the one with the
+ *                            lowest index is rethrown after all jobs are done.
+ */
+void Thread_Pool::run(unsigned int count, const std::function<void(unsigned int)>& new_job)
+{
+	if(!count)
+		return;
+
+	std::vector<std::exception_ptr> new_errors(count);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle_cv.wait(lock, [this]{ return job == nullptr; });
+
+		job = &new_job;
+		errors = &new_errors;
+		next_index = 0;
+		job_count = count;
+		remaining = count;
+		work_cv.notify_all();
+
+		// help out while waiting
+		execute(lock);
+		done_cv.wait(lock, [this]{ return remaining == 0; });
+
+		job = nullptr;
+		errors = nullptr;
+	}
+	idle_cv.notify_one();
+
+	for(auto && i : new_errors)
+	{
+		if(i)
+			std::rethrow_exception(i);
+	}
+}
+
+//! Worker thread
+void Thread_Pool::worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!quit)
+	{
+		if(job && next_index < job_count)
+			execute(lock);
+		else
+			work_cv.wait(lock);
+	}
+}
+
+//! Process jobs from the current batch until there are none left.
+void Thread_Pool::execute(std::unique_lock<std::mutex>& lock)
+{
+	while(job && next_index < job_count)
+	{
+		unsigned int index = next_index++;
+		auto current_job = job;
+		auto current_errors = errors;
+
+		lock.unlock();
+		try
+		{
+			(*current_job)(index);
+		}
+		catch(...)
+		{
+			(*current_errors)[index] = std::current_exception();
+		}
+		lock.lock();
+
+		if(!--remaining)
+			done_cv.notify_all();
+	}
+}
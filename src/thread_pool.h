@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+
+//! Fixed size worker pool for data parallel jobs.
+/*!
+ *  Jobs are submitted as a batch of indexes using run(). Only one batch
+ *  is processed at a time, other callers wait until the pool is idle.
+ *  The calling thread also helps with processing its own batch.
+ *
+ *  Do not call run() from inside a job, as this will deadlock.
+ */
+class Thread_Pool
+{
+	public:
+		Thread_Pool(unsigned int thread_count = 0);
+		virtual ~Thread_Pool();
+
+		// not copyable
+		Thread_Pool(Thread_Pool const&) = delete;
+		void operator=(Thread_Pool const&) = delete;
+
+		static Thread_Pool& get();
+		static void set_default_thread_count(unsigned int count);
+
+		//! Get the number of threads used for processing, including the caller.
+		inline unsigned int get_thread_count() const { return threads.size() + 1; }
+
+		void run(unsigned int count, const std::function<void(unsigned int)>& job);
+
+	private:
+		void worker();
+		void execute(std::unique_lock<std::mutex>& lock);
+
+		std::mutex mutex;
+		std::condition_variable work_cv;
+		std::condition_variable done_cv;
+		std::condition_variable idle_cv;
+		std::vector<std::thread> threads;
+
+		// current batch
+		const std::function<void(unsigned int)>* job;
+		std::vector<std::exception_ptr>* errors;
+		unsigned int next_index;
+		unsigned int job_count;
+		unsigned int remaining;
+
+		bool quit;
+
+		static unsigned int default_thread_count;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "timeline_index.h"
+
+#include <algorithm>
+
+//! Generate the timeline index for all tracks in a song.
+/*!
+ *  \param tracks Track_Info of every track. It must outlive the index.
+ */
+Timeline_Index::Timeline_Index(const std::map<int, Track_Info>& tracks)
+{
+	add_tracks(tracks);
+}
+
+//! Extend the index of a previous Track_Info pass.
+/*!
+ *  Events that were added to the tracks since \p previous was generated
+ *  are added to the index. If the new notes can't be added at the end,
+ *  or the tracks are not the ones \p previous was generated from, the
+ *  index is generated again from all events.
+ *
+ *  \param tracks Track_Info of every track, with the same events as the
+ *                tracks of \p previous at the start. It must outlive the index.
+ */
+Timeline_Index::Timeline_Index(const Timeline_Index& previous, const std::map<int, Track_Info>& tracks)
+	: notes(previous.notes)
+	, max_end(previous.max_end)
+	, track_events(previous.track_events)
+{
+	if(!add_tracks(tracks))
+	{
+		notes.clear();
+		max_end.clear();
+		track_events.clear();
+		add_tracks(tracks);
+	}
+}
+
+//! Add the events after the ones already in the index.
+/*!
+ *  \return false if a new note starts before the last note in the index,
+ *          or a track was removed or has fewer events than before. The
+ *          index is not valid in this case.
+ */
+bool Timeline_Index::add_tracks(const std::map<int, Track_Info>& tracks)
+{
+	std::vector<Note> new_notes;
+	loop_tracks.clear();
+
+	for(auto && i : tracks)
+	{
+		const Track_Info& info = i.second;
+		std::size_t& first = track_events[i.first];
+		if(first > info.events.size())
+			return false;
+		for(std::size_t index = first; index < info.events.size(); index++)
+		{
+			int time = info.events.get_time(index);
+			int on_time = info.events.get_on_time(index);
+			if(on_time)
+				new_notes.push_back({time, time + on_time, i.first, (uint32_t)index});
+		}
+		first = info.events.size();
+		if(info.loop_length && info.loop_start >= 0)
+			loop_tracks.push_back({i.first, &info});
+	}
+	if(track_events.size() != tracks.size())
+		return false;
+
+	// Each track is already sorted, so a stable sort keeps the track order for notes starting together.
+	std::stable_sort(new_notes.begin(), new_notes.end(), [](const Note& a, const Note& b) { return a.start < b.start; });
+	if(new_notes.size() && notes.size() && new_notes.front().start < notes.back().start)
+		return false;
+
+	notes.append(new_notes.begin(), new_notes.end());
+	int end = max_end.size() ? max_end.back() : 0;
+	for(auto && note : new_notes)
+	{
+		end = std::max(end, note.end);
+		max_end.push_back(end);
+	}
+	return true;
+}
+
+//! Find the notes sounding at a song position.
+/*!
+ *  \param results Output vector. Results are appended.
+ *  \return the number of results appended.
+ */
+unsigned int Timeline_Index::find(int time, std::vector<Result>& results) const
+{
+	return find(time, time + 1, results);
+}
+
+//! Find the notes sounding between two song positions.
+/*!
+ *  Notes from the first pass of each track are returned first, sorted by
+ *  start time. They are followed by notes from loop repetitions, for each
+ *  track at most max_loop_spans repetitions.
+ *
+ *  \param start Start of the range, in ticks.
+ *  \param end   End of the range (exclusive), in ticks.
+ *  \param results Output vector. Results are appended.
+ *  \return the number of results appended.
+ */
+unsigned int Timeline_Index::find(int start, int end, std::vector<Result>& results) const
+{
+	std::size_t size = results.size();
+	if(end <= start)
+		return 0;
+
+	// Notes starting before the end of the range.
+	std::size_t last = std::lower_bound(notes.begin(), notes.end(), end,
+		[](const Note& n, int time) { return n.start < time; }) - notes.begin();
+
+	// Skip the notes before the first one that could still be sounding at the start.
+	std::size_t first = std::upper_bound(max_end.begin(), max_end.begin() + last, start) - max_end.begin();
+
+	for(std::size_t i = first; i < last; i++)
+	{
+		if(notes[i].end > start)
+			results.push_back({notes[i].track_id, notes[i].index, 0});
+	}
+
+	// Loop repetitions after the end of the first pass.
+	Track_Info::Span spans[max_loop_spans];
+	for(auto && track : loop_tracks)
+	{
+		const Track_Info& info = *track.info;
+		int loop_end = info.length;
+		if(end <= loop_end)
+			continue;
+
+		unsigned int span_count = info.events_in_range(std::max(start, loop_end), end, spans, max_loop_spans);
+		for(unsigned int span = 0; span < span_count; span++)
+		{
+			for(auto i = spans[span].first; i < spans[span].last; i++)
+			{
+				int time = info.events.get_time(i) + spans[span].offset;
+				int on_time = info.events.get_on_time(i);
+				if(on_time && time >= loop_end && time < end && time + on_time > start)
+					results.push_back({track.track_id, i, spans[span].offset});
+			}
+		}
+	}
+	return results.size() - size;
+}
+
+//! Find the notes sounding between two song positions by walking every event of every track.
+/*!
+ *  This gives the same results as find(), in a different order, and
+ *  without limiting the number of loop repetitions. Used for testing.
+ */
+unsigned int Timeline_Index::scan(const std::map<int, Track_Info>& tracks, int start, int end, std::vector<Result>& results)
+{
+	std::size_t size = results.size();
+	if(end <= start)
+		return 0;
+
+	for(auto && track : tracks)
+	{
+		const Track_Info& info = track.second;
+		bool loop = info.loop_length && info.loop_start >= 0;
+		for(int offset = 0; offset < end; offset += info.loop_length)
+		{
+			for(std::size_t i = 0; i < info.events.size(); i++)
+			{
+				int time = info.events.get_time(i);
+				int on_time = info.events.get_on_time(i);
+				if(offset && time < info.loop_start)
+					continue;
+				if(on_time && time + offset < end && time + offset + on_time > start)
+					results.push_back({track.first, i, offset});
+			}
+			if(!loop)
+				break;
+		}
+	}
+	return results.size() - size;
+}
@@ -0,0 +1,74 @@
+#ifndef TIMELINE_INDEX_H
+#define TIMELINE_INDEX_H
+
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "track_info.h"
+#include "shared_array.h"
+
+//! Index of the notes sounding at any song position, over all tracks.
+/*!
+ *  This is generated once per compile from the Track_Info of every track.
+ *  The notes of all tracks are merged into a single array sorted by start
+ *  time, along with the running maximum of the end times. A query is then
+ *  two binary searches, followed by a walk over the notes that start
+ *  before the end of the range but have not yet ended.
+ *
+ *  Only the first pass of each track is merged. Looping tracks are looked
+ *  up separately after the end of their first pass, using
+ *  Track_Info::events_in_range().
+ *
+ *  When Track_Info is generated in several passes, the index of the
+ *  previous pass can be extended with the new events instead of being
+ *  generated again. Copies share the note arrays, so this does not copy
+ *  the previous notes.
+ */
+class Timeline_Index
+{
+	public:
+		//! Note found by a query.
+		struct Result
+		{
+			int track_id;
+			std::size_t index;			// index in Track_Info::events
+			int offset;					// add to the event play time to get the time in the song
+		};
+
+		Timeline_Index(const std::map<int, Track_Info>& tracks);
+		Timeline_Index(const Timeline_Index& previous, const std::map<int, Track_Info>& tracks);
+
+		unsigned int find(int time, std::vector<Result>& results) const;
+		unsigned int find(int start, int end, std::vector<Result>& results) const;
+
+		inline std::size_t size() const { return notes.size(); }
+
+		static unsigned int scan(const std::map<int, Track_Info>& tracks, int start, int end, std::vector<Result>& results);
+
+	private:
+		const static unsigned int max_loop_spans = 64; // loop repetitions returned per track
+
+		bool add_tracks(const std::map<int, Track_Info>& tracks);
+
+		struct Note
+		{
+			int start;
+			int end;					// exclusive
+			int track_id;
+			uint32_t index;
+		};
+
+		struct Loop_Track
+		{
+			int track_id;
+			const Track_Info* info;
+		};
+
+		Shared_Array<Note> notes;
+		Shared_Array<int> max_end;		// maximum end time of notes[0] to notes[i]
+		std::vector<Loop_Track> loop_tracks;
+		std::map<int, std::size_t> track_events;	// number of events of each track in the index
+};
+
+#endif
@@ -3,24 +3,44 @@
 
 //! Generate Track_Info
 /*!
+ * \param ref_pool Pool for the event references. Generators running in parallel may share a pool,
+ *                 each generator adds its own shard.
+ * \param end_time Stop generating at this play time. Use generate() to continue later.
+ *                 By default the entire track is generated.
  * \exception InputError if any validation errors occur. These should be displayed to the user.
  */
-Track_Info_Generator::Track_Info_Generator(Song& song, Track& track)
+Track_Info_Generator::Track_Info_Generator(Song& song, Track& track, Ref_Pool& ref_pool, unsigned int end_time)
 	: Player(song, track)
 	, Track_Info()
 	, slur_flag(0)
+	, ref_shard(ref_pool.add_shard())
 {
 	loop_start = -1;
 	loop_length = 0;
 	length = 0;
+	complete = false;
 
-	// step all the way to the end
-	while(is_enabled())
+	generate(end_time);
+}
+
+//! Continue generating Track_Info.
+/*!
+ * Steps the track until the play time reaches \p end_time. The last event may
+ * extend past \p end_time.
+ *
+ * \return true if the entire track has been generated.
+ * \exception InputError if any validation errors occur. These should be displayed to the user.
+ */
+bool Track_Info_Generator::generate(unsigned int end_time)
+{
+	while(is_enabled() && get_play_time() < end_time)
 		step_event();
 
 	length = get_play_time();
-	if(loop_start >= 0)
+	complete = !is_enabled();
+	if(complete && loop_start >= 0)
 		loop_length = length - loop_start;
+	return complete;
 }
 
 void Track_Info_Generator::write_event()
@@ -42,13 +62,17 @@ void Track_Info_Generator::write_event()
 		ext.transpose = get_var(Event::TRANSPOSE);
 		ext.pitch_envelope = get_var(Event::PITCH_ENVELOPE);
 		ext.portamento = get_var(Event::PORTAMENTO);
-		ext.references = get_references();
-		if(get_var(Event::DRUM_MODE))
-			ext.references.push_back(reference);
-		events.emplace_hint(events.end(), std::pair<int, Track_Info::Ext_Event>(get_play_time(), ext));
+		reference_buffer.clear();
+		ref_shard.intern(get_references(), reference_buffer);
+		if(get_var(Event::DRUM_MODE) && reference)
+			reference_buffer.push_back(ref_shard.intern(reference));
+		events.push_back(get_play_time(), ext, reference_buffer);
 
 		slur_flag = false;
 	}
+	// Record tempo changes for the tempo map.
+	else if(event.type == Event::TEMPO_BPM)
+		tempo_events.push_back({(int)get_play_time(), (uint16_t)event.param});
 	// Record timestamp of segno event.
 	else if(event.type == Event::SEGNO)
 		loop_start = get_play_time();
@@ -57,8 +81,211 @@ void Track_Info_Generator::write_event()
 		slur_flag = true;
 }
 
+//! Find the events that are playing between two song positions.
+/*!
+ *  The loop section is repeated after the end of the track, so a range
+ *  may return several spans of the same events with different offsets.
+ *  The first span starts with the event that is playing at \p start.
+ *  Tracks without a loop, or with a zero length loop, end after the
+ *  last event.
+ *
+ *  \param start Start of the range, in ticks.
+ *  \param end   End of the range (exclusive), in ticks.
+ *  \param spans Output array.
+ *  \param max_spans Size of the output array. The query stops when it is full.
+ *  \return the number of spans written.
+ */
+unsigned int Track_Info::events_in_range(int start, int end, Span* spans, unsigned int max_spans) const
+{
+	unsigned int count = 0;
+	std::size_t size = events.size();
+
+	if(!size || end <= start || !max_spans)
+		return 0;
+
+	// calculate offset to the loop repetition containing the start position
+	int offset = 0;
+	if(loop_length && start >= (int)length)
+		offset = ((start - loop_start) / (int)loop_length) * loop_length;
+	else if(start >= (int)length)
+		return 0;
+
+	// find the event playing at the start position
+	std::size_t first = events.lower_bound(start - offset).get_index();
+	if(first == size || events.get_time(first) > start - offset)
+	{
+		if(first > 0)
+			first--;
+	}
+
+	while(count < max_spans)
+	{
+		std::size_t last = events.lower_bound(end - offset).get_index();
+		if(last <= first)
+			break;
+
+		spans[count++] = {first, last, offset};
+
+		// stop if the range ends before the end of the track, or if there is no loop
+		if(last < size || !loop_length)
+			break;
+
+		// go back to loop point
+		offset += loop_length;
+		first = events.lower_bound(loop_start).get_index();
+		if(first == size || events.get_time(first) + offset >= end)
+			break;
+	}
+	return count;
+}
+
+//! Find the song positions where two Track_Info differ.
+/*!
+ *  Events are compared from the start and from the end of the lists, so
+ *  that an edit in the middle of a track only reports the ticks between
+ *  the first and last changed event. References are not compared, since
+ *  reference ids from different compiles have no relation.
+ *
+ *  Tempo commands are also compared. A changed tempo command moves
+ *  everything after it, so the rest of the track is reported as changed.
+ *
+ *  \param start Set to the first changed tick.
+ *  \param end   Set to the end of the changed ticks (exclusive). INT_MAX if
+ *                the rest of the track may have changed, which is the case
+ *                if the loop or a tempo command changed or either track is
+ *                not complete.
+ *  \return true if the tracks differ. \p start and \p end are only set in
+ *          this case.
+ */
+bool Track_Info::compare(const Track_Info& other, int& start, int& end) const
+{
+	std::size_t size = events.size();
+	std::size_t other_size = other.events.size();
+
+	// Skip identical events at the start
+	std::size_t first = 0;
+	while(first < size && first < other_size && events.equals(first, other.events, first))
+		first++;
+
+	// Skip identical tempo commands
+	std::size_t tempo_size = tempo_events.size();
+	std::size_t other_tempo_size = other.tempo_events.size();
+	std::size_t tempo_first = 0;
+	while(tempo_first < tempo_size && tempo_first < other_tempo_size
+		&& tempo_events[tempo_first].time == other.tempo_events[tempo_first].time
+		&& tempo_events[tempo_first].bpm == other.tempo_events[tempo_first].bpm)
+		tempo_first++;
+
+	bool same_loop = loop_start == other.loop_start && loop_length == other.loop_length;
+	bool same_tempo = tempo_first == tempo_size && tempo_first == other_tempo_size;
+	if(first == size && first == other_size && same_loop && same_tempo && length == other.length && complete == other.complete)
+		return false;
+
+	start = std::min((first < size) ? events.get_time(first) : (int)length,
+		(first < other_size) ? other.events.get_time(first) : (int)other.length);
+	if(!same_tempo)
+	{
+		start = std::min(start, (tempo_first < tempo_size) ? tempo_events[tempo_first].time : (int)length);
+		start = std::min(start, (tempo_first < other_tempo_size) ? other.tempo_events[tempo_first].time : (int)other.length);
+	}
+
+	if(!complete || !other.complete || !same_loop || !same_tempo || (loop_length && length != other.length))
+	{
+		end = INT_MAX;
+		return true;
+	}
+
+	// Skip identical events at the end. They must be at the same play time.
+	std::size_t last = size, other_last = other_size;
+	while(last > first && other_last > first
+		&& events.get_time(last - 1) == other.events.get_time(other_last - 1)
+		&& events.equals(last - 1, other.events, other_last - 1))
+	{
+		last--;
+		other_last--;
+	}
+
+	end = start;
+	if(last > first)
+		end = std::max(end, events.get_end_time(last - 1));
+	if(other_last > first)
+		end = std::max(end, other.events.get_end_time(other_last - 1));
+	if(length != other.length)
+		end = std::max(end, (int)std::max(length, other.length));
+	return true;
+}
+
 bool Track_Info_Generator::loop_hook()
 {
 	// do not loop
 	return 0;
 }
+
+//! Add an event to the end of the list.
+/*!
+ *  Events must be added in increasing play time order. Like std::map, an
+ *  event is ignored if there is already an event at the same play time.
+ */
+void Track_Info::Event_List::push_back(int position, const Ext_Event& event, const std::vector<Ref_Pool::Id>& references)
+{
+	if(time.size() && time.back() >= position)
+		return;
+
+	time.push_back(position);
+	note.push_back(event.note);
+	on_time.push_back(event.on_time);
+	off_time.push_back(event.off_time);
+	flags.push_back((event.is_tie ? FLAG_TIE : 0)
+		| (event.is_slur ? FLAG_SLUR : 0)
+		| (event.coarse_volume_flag ? FLAG_COARSE_VOLUME : 0));
+	volume.push_back(event.volume);
+	instrument.push_back(event.instrument);
+	transpose.push_back(event.transpose);
+	pitch_envelope.push_back(event.pitch_envelope);
+	portamento.push_back(event.portamento);
+
+	if(!reference_index.size())
+		reference_index.push_back(0);
+	reference_list.append(references.begin(), references.end());
+	reference_index.push_back(reference_list.size());
+}
+
+//! Compare an event with an event in another list.
+/*!
+ *  The play time and all attributes except the references are compared.
+ */
+bool Track_Info::Event_List::equals(std::size_t index, const Event_List& other, std::size_t other_index) const
+{
+	return time[index] == other.time[other_index]
+		&& note[index] == other.note[other_index]
+		&& on_time[index] == other.on_time[other_index]
+		&& off_time[index] == other.off_time[other_index]
+		&& flags[index] == other.flags[other_index]
+		&& volume[index] == other.volume[other_index]
+		&& instrument[index] == other.instrument[other_index]
+		&& transpose[index] == other.transpose[other_index]
+		&& pitch_envelope[index] == other.pitch_envelope[other_index]
+		&& portamento[index] == other.portamento[other_index];
+}
+
+//! Get a copy of an event.
+Track_Info::Event_List::value_type Track_Info::Event_List::get(std::size_t index) const
+{
+	value_type value;
+	value.first = time[index];
+
+	Ext_Event& event = value.second;
+	event.note = note[index];
+	event.on_time = on_time[index];
+	event.is_tie = is_tie(index);
+	event.is_slur = is_slur(index);
+	event.off_time = off_time[index];
+	event.coarse_volume_flag = is_coarse_volume(index);
+	event.volume = volume[index];
+	event.instrument = instrument[index];
+	event.transpose = transpose[index];
+	event.pitch_envelope = pitch_envelope[index];
+	event.portamento = portamento[index];
+	event.references = get_references(index);
+	return value;
+}
@@ -1,13 +1,28 @@
 #ifndef TRACK_INFO_H
 #define TRACK_INFO_H
 
-#include <map>
+#include <vector>
 #include <memory>
+#include <algorithm>
+#include <climits>
 
 #include "player.h"
+#include "ref_pool.h"
+#include "shared_array.h"
 
 struct Track_Info
 {
+	//! Range of reference ids belonging to an event. The ids belong to the Ref_Pool used by the generator.
+	struct Reference_Range
+	{
+		const Ref_Pool::Id* first;
+		const Ref_Pool::Id* last;
+
+		inline const Ref_Pool::Id* begin() const { return first; }
+		inline const Ref_Pool::Id* end() const { return last; }
+		inline std::size_t size() const { return last - first; }
+	};
+
 	//! Extended event struct
 	struct Ext_Event
 	{
@@ -25,26 +40,170 @@ struct Track_Info
 		uint16_t pitch_envelope;
 		uint16_t portamento;
 
-		std::vector<std::shared_ptr<InputRef>> references;
+		Reference_Range references;
 	};
 
-	std::map<int, Ext_Event> events;
+	//! Event list sorted by play time.
+	/*!
+	 *  The events are stored as one array per attribute, so that searching
+	 *  and stepping through the list only touches the arrays that are needed.
+	 *
+	 *  Copying the list does not copy the events. The copy shares the
+	 *  arrays with the original, which can continue to add events.
+	 *
+	 *  Iterators behave like std::map<int, Ext_Event> iterators, except that
+	 *  dereferencing returns a temporary copy of the event. Do not keep
+	 *  pointers to it->second. Loops that only need a few attributes should
+	 *  use the per-attribute accessors instead.
+	 */
+	class Event_List
+	{
+		public:
+			struct value_type
+			{
+				int first;				// play time
+				Ext_Event second;
+			};
+
+			class const_iterator
+			{
+				public:
+					//! Holds the temporary event for operator->.
+					struct Arrow_Proxy
+					{
+						value_type value;
+						inline const value_type* operator->() const { return &value; }
+					};
+
+					inline const_iterator() : list(nullptr), index(0) {}
+					inline const_iterator(const Event_List* list, std::size_t index) : list(list), index(index) {}
+
+					inline value_type operator*() const { return list->get(index); }
+					inline Arrow_Proxy operator->() const { return {list->get(index)}; }
+
+					inline const_iterator& operator++() { index++; return *this; }
+					inline const_iterator operator++(int) { const_iterator it = *this; index++; return it; }
+					inline const_iterator& operator--() { index--; return *this; }
+					inline const_iterator operator--(int) { const_iterator it = *this; index--; return it; }
+
+					inline bool operator==(const const_iterator& other) const { return index == other.index && list == other.list; }
+					inline bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+					//! Get the position of the event in the list.
+					inline std::size_t get_index() const { return index; }
+
+				private:
+					const Event_List* list;
+					std::size_t index;
+			};
+			typedef const_iterator iterator;
+
+			void push_back(int position, const Ext_Event& event, const std::vector<Ref_Pool::Id>& references);
+			value_type get(std::size_t index) const;
+			bool equals(std::size_t index, const Event_List& other, std::size_t other_index) const;
+
+			inline std::size_t size() const { return time.size(); }
+			inline bool empty() const { return time.empty(); }
+
+			//! Get the play time of an event.
+			inline int get_time(std::size_t index) const { return time[index]; }
+
+			//! Get the play time at the end of an event, including the gap.
+			inline int get_end_time(std::size_t index) const { return time[index] + on_time[index] + off_time[index]; }
+
+			// Access a single attribute of an event without copying the others.
+			inline uint16_t get_note(std::size_t index) const { return note[index]; }
+			inline uint16_t get_on_time(std::size_t index) const { return on_time[index]; }
+			inline uint16_t get_off_time(std::size_t index) const { return off_time[index]; }
+			inline bool is_tie(std::size_t index) const { return flags[index] & FLAG_TIE; }
+			inline bool is_slur(std::size_t index) const { return flags[index] & FLAG_SLUR; }
+			inline bool is_coarse_volume(std::size_t index) const { return flags[index] & FLAG_COARSE_VOLUME; }
+			inline uint16_t get_volume(std::size_t index) const { return volume[index]; }
+			inline uint16_t get_instrument(std::size_t index) const { return instrument[index]; }
+			inline int16_t get_transpose(std::size_t index) const { return transpose[index]; }
+			inline uint16_t get_pitch_envelope(std::size_t index) const { return pitch_envelope[index]; }
+			inline uint16_t get_portamento(std::size_t index) const { return portamento[index]; }
+
+			//! Get the references of an event.
+			inline Reference_Range get_references(std::size_t index) const
+			{
+				return {reference_list.data() + reference_index[index], reference_list.data() + reference_index[index + 1]};
+			}
+
+			inline const_iterator begin() const { return const_iterator(this, 0); }
+			inline const_iterator end() const { return const_iterator(this, time.size()); }
+
+			//! Find the first event at or after a play time.
+			inline const_iterator lower_bound(int position) const
+			{
+				return const_iterator(this, std::lower_bound(time.begin(), time.end(), position) - time.begin());
+			}
+
+		private:
+			enum Flags
+			{
+				FLAG_TIE = 1<<0,
+				FLAG_SLUR = 1<<1,
+				FLAG_COARSE_VOLUME = 1<<2
+			};
+
+			Shared_Array<int> time;
+			Shared_Array<uint16_t> note;
+			Shared_Array<uint16_t> on_time;
+			Shared_Array<uint16_t> off_time;
+			Shared_Array<uint8_t> flags;
+			Shared_Array<uint16_t> volume;
+			Shared_Array<uint16_t> instrument;
+			Shared_Array<int16_t> transpose;
+			Shared_Array<uint16_t> pitch_envelope;
+			Shared_Array<uint16_t> portamento;
+
+			// references of event i are reference_list[reference_index[i]] to reference_list[reference_index[i+1]-1]
+			Shared_Array<uint32_t> reference_index;
+			Shared_Array<Ref_Pool::Id> reference_list;
+	};
+
+	//! Tempo command in the track.
+	struct Tempo_Event
+	{
+		int time;							// play time
+		uint16_t bpm;
+	};
+
+	//! Contiguous run of events from a range query.
+	struct Span
+	{
+		std::size_t first;			// index of the first event
+		std::size_t last;			// index after the last event
+		int offset;					// add to the event play time to get the time in the song
+	};
+
+	unsigned int events_in_range(int start, int end, Span* spans, unsigned int max_spans) const;
+	bool compare(const Track_Info& other, int& start, int& end) const;
+
+	Event_List events;
+	std::vector<Tempo_Event> tempo_events;
 
 	int loop_start;						// -1 for no loop
 	unsigned int loop_length;
-	unsigned int length;
+	unsigned int length;				// generated length if not complete
+	bool complete;						// false if only the beginning of the track has been generated
 };
 
 class Track_Info_Generator : public Player, public Track_Info
 {
 	public:
-		Track_Info_Generator(Song& song, Track& track);
+		Track_Info_Generator(Song& song, Track& track, Ref_Pool& ref_pool, unsigned int end_time = UINT_MAX);
+
+		bool generate(unsigned int end_time);
 
 	private:
 		void write_event() override;
 		bool loop_hook() override;
 
 		bool slur_flag;
+		Ref_Pool::Shard& ref_shard;			// references are only added by this generator
+		std::vector<Ref_Pool::Id> reference_buffer; // reused for each event
 };
 
 #endif
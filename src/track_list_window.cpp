@@ -1,5 +1,6 @@
 #include "track_list_window.h"
 #include "track_info.h"
+#include "tempo_map.h"
 #include "song.h"
 
 Track_List_Window::Track_List_Window(std::shared_ptr<Song_Manager> song_mgr)
@@ -23,7 +24,11 @@ void Track_List_Window::display()
 	ImGui::Text("Loop"); ImGui::NextColumn();
 	ImGui::Separator();
 
-	Song_Manager::Track_Map& map = *song_manager->get_tracks();
+	// Use the same compile result for the entire frame
+	static const Song_Manager::Track_Map empty_map = {};
+	auto snapshot = song_manager->get_snapshot();
+	auto tracks = (snapshot != nullptr) ? snapshot->tracks : nullptr;
+	const Song_Manager::Track_Map& map = (tracks != nullptr) ? *tracks : empty_map;
 
 	for(auto&& i : map)
 	{
@@ -51,7 +56,12 @@ void Track_List_Window::display()
 			}
 		}
 		ImGui::NextColumn();
-		ImGui::Text("%5d", i.second.length);
+		if(i.second.complete)
+			ImGui::Text("%5d", i.second.length);
+		else
+			ImGui::Text("%5d+", i.second.length);
+		if(ImGui::IsItemHovered() && snapshot->tempo_map != nullptr)
+			ImGui::SetTooltip("%.3f s", snapshot->tempo_map->get_seconds(i.second.length));
 		ImGui::NextColumn();
 		ImGui::Text("%5d", i.second.loop_length);
 		ImGui::NextColumn();
@@ -27,10 +27,12 @@
 
 #include "track_view_window.h"
 #include "track_info.h"
+#include "tempo_map.h"
 #include "song.h"
 
 #include <string>
 #include <cmath>
+#include <algorithm>
 
 // max objects drawn per object per frame
 const int Track_View_Window::max_objs_per_column = 200;
@@ -67,12 +69,20 @@ Track_View_Window::Track_View_Window(std::shared_ptr<Song_Manager> song_mgr)
 	, y_player(0)
 	, y_user(0.0)
 	, song_manager(song_mgr)
+	, snapshot(nullptr)
 	, dragging(false)
+	, hover_time(0)
+	, hover_track(nullptr)
+	, hover_position(0)
+	, draw_track(nullptr)
 {
 }
 
 void Track_View_Window::display()
 {
+	// Use the same compile result for the entire frame
+	snapshot = song_manager->get_snapshot();
+
 	// Draw window
 	std::string window_id;
 	window_id = "Track View##" + std::to_string(id);
@@ -86,6 +96,17 @@ void Track_View_Window::display()
 		ImGui::InputScalar("Time", ImGuiDataType_U32, &y_player, NULL, NULL, "%d.00", ImGuiInputTextFlags_ReadOnly);
 	else
 		ImGui::InputDouble("Time", &y_user, 1.0f, 1.0f, "%.2f");
+
+	// Show the position in seconds, or seek by seconds
+	if(snapshot != nullptr && snapshot->tempo_map != nullptr)
+	{
+		ImGui::SameLine();
+		double seconds = snapshot->tempo_map->get_seconds(y_player ? y_player : y_user);
+		if(y_player)
+			ImGui::InputDouble("Seconds", &seconds, 0.0f, 0.0f, "%.3f", ImGuiInputTextFlags_ReadOnly);
+		else if(ImGui::InputDouble("Seconds", &seconds, 0.1f, 1.0f, "%.3f"))
+			y_user = std::max(0.0, snapshot->tempo_map->get_ticks(seconds));
+	}
 	ImGui::SameLine();
 	ImGui::InputDouble("Scale", &y_scale_log, 0.01f, 0.1f, "%.2f");
 	ImGui::SameLine();
@@ -104,6 +125,12 @@ void Track_View_Window::display()
 	draw_list = ImGui::GetWindowDrawList();
 	cursor_list.clear();
 
+	if(snapshot == nullptr || snapshot->song == nullptr || snapshot->tracks == nullptr)
+	{
+		ImGui::End();
+		return;
+	}
+
 	// draw background
 	draw_list->AddRectFilled(
 		canvas_pos,
@@ -117,6 +144,7 @@ void Track_View_Window::display()
 		true);
 	draw_ruler();
 	draw_list->PopClipRect();
+	hover_ruler();
 
 	// draw track events
 	draw_list->PushClipRect(
@@ -172,6 +200,10 @@ void Track_View_Window::update_position()
 			dragging = false;
 		}
 	}
+
+	// Request Track_Info for the visible area first
+	double y_end = y_pos + canvas_size.y / y_scale;
+	song_manager->set_view_end((y_end > 0) ? y_end : 0);
 }
 
 //! Handle user input
@@ -216,7 +248,7 @@ void Track_View_Window::draw_ruler()
 	int yp = y_pos;
 
 	// calculate time signature
-	unsigned int whole = song_manager->get_song()->get_ppqn() * 4;
+	unsigned int whole = snapshot->song->get_ppqn() * 4;
 	unsigned int beat_len = whole / measure_beat_value;
 	//unsigned int measure_len = measure_beat_value * measure_beat_count;
 
@@ -312,7 +344,7 @@ void Track_View_Window::draw_track_header()
 		ImVec2(x2,y2),
 		fill_color);
 
-	Song_Manager::Track_Map& map = *song_manager->get_tracks();
+	const Song_Manager::Track_Map& map = *snapshot->tracks;
 
 	double x = std::floor(ruler_width * 2.0);
 
@@ -363,63 +395,50 @@ void Track_View_Window::draw_track_header()
 //! Draw the tracks
 void Track_View_Window::draw_tracks()
 {
-	auto map = song_manager->get_tracks();
+	auto& map = snapshot->tracks;
 
 	double x = std::floor(ruler_width * 2.0);
 
-	int y_off = 0;
 	double yr = y_pos * y_scale;
 
+	// Visible range. One extra tick is included to draw the border of the next event.
+	int start = y_pos;
+	int end = std::ceil(y_pos + canvas_size.y / y_scale) + 1;
+
+	Track_Info::Span spans[max_spans_per_column];
+
 	for(auto track_it = map->begin(); track_it != map->end(); track_it++)
 	{
 		auto& info = track_it->second;
-
-		// calculate offset to first loop
-		if(y_pos > info.length && info.loop_length)
-			y_off = (((int)y_pos - info.loop_start) / info.loop_length) * info.loop_length;
-		else
-			y_off = 0;
-
-		// calculate position
-		auto it = info.events.lower_bound(y_pos - y_off);
-		double y = (it->first + y_off) * y_scale - yr;
+		draw_track = &info;
 
 		border_complete = true;
-		last_ref = nullptr;
+		last_ref = Ref_Pool::invalid_id;
 
-		// draw the previous event if we can
-		if(it != info.events.begin())
-		{
-			--it;
-			y = (it->first + y_off) * y_scale - yr;
-			y = draw_event(x, y, it->first, it->second);
-			++it;
-		}
+		unsigned int span_count = info.events_in_range(start, end, spans, max_spans_per_column);
+		int obj_count = 0;
 
 		// draw each event
-		for(int i=0; i<max_objs_per_column; i++)
+		for(unsigned int span = 0; span < span_count && obj_count < max_objs_per_column; span++)
 		{
-			if(it == info.events.end())
-			{
-				// go back to loop point if possible
-				if(info.loop_length)
-					it = info.events.lower_bound(info.loop_start);
-				else
-					break;
-			}
-			if(y > canvas_size.y)
+			for(auto i = spans[span].first; i < spans[span].last && obj_count < max_objs_per_column; i++, obj_count++)
 			{
-				if(it->second.on_time)
+				int position = info.events.get_time(i);
+				double y = (position + spans[span].offset) * y_scale - yr;
+				if(y > canvas_size.y)
 				{
-					double x1 = canvas_pos.x + std::floor(x);
-					double x2 = canvas_pos.x + std::floor(x + track_width);
-					double y1 = canvas_pos.y + std::floor(y);
-					draw_event_border(x1, x2, y1, it->second);
+					if(info.events.get_on_time(i))
+					{
+						double x1 = canvas_pos.x + std::floor(x);
+						double x2 = canvas_pos.x + std::floor(x + track_width);
+						double y1 = canvas_pos.y + std::floor(y);
+						draw_event_border(x1, x2, y1, info.events, i);
+					}
+					obj_count = max_objs_per_column;
+					break;
 				}
-				break;
+				draw_event(x, y, position, info.events, i);
 			}
-			y = draw_event(x, y, it->first, it->second);
-			it++;
 		}
 
 		x += std::floor(track_width + padding_width);
@@ -427,14 +446,17 @@ void Track_View_Window::draw_tracks()
 }
 
 //! Draw a single event
-double Track_View_Window::draw_event(double x, double y, int position, const Track_Info::Ext_Event& event)
+double Track_View_Window::draw_event(double x, double y, int position, const Track_Info::Event_List& events, std::size_t index)
 {
+	uint16_t on_time = events.get_on_time(index);
+	uint16_t off_time = events.get_off_time(index);
+
 	// calculate coordinates
 	double x1  = canvas_pos.x + std::floor(x);
 	double x2  = canvas_pos.x + std::floor(x + track_width);
 	double y1  = canvas_pos.y + std::floor(y);
-	double y2  = canvas_pos.y + std::floor(y + event.on_time * y_scale);
-	double y2a = canvas_pos.y + std::floor(y + (event.on_time + event.off_time) * y_scale);
+	double y2  = canvas_pos.y + std::floor(y + on_time * y_scale);
+	double y2a = canvas_pos.y + std::floor(y + (on_time + off_time) * y_scale);
 	ImU32 fill_color = IM_COL32(195, 0, 0, 255);
 
 	//testing
@@ -443,13 +465,13 @@ double Track_View_Window::draw_event(double x, double y, int position, const Tra
 		&& ImGui::IsItemHovered())
 	{
 		fill_color = IM_COL32(235, 40, 40, 255);
-		hover_event(position, event);
+		hover_event(position, events.get(index).second);
 	}
 
 	// draw the note
-	if(event.on_time)
+	if(on_time)
 	{
-		draw_event_border(x1, x2, y1, event);
+		draw_event_border(x1, x2, y1, events, index);
 
 		draw_list->AddRectFilled(
 			ImVec2(x1,y1),
@@ -458,10 +480,10 @@ double Track_View_Window::draw_event(double x, double y, int position, const Tra
 
 		// draw note text
 		ImFont* font = ImGui::GetFont();
-		if(!event.is_tie && std::floor(event.on_time * y_scale) > font->FontSize)
+		if(!events.is_tie(index) && std::floor(on_time * y_scale) > font->FontSize)
 		{
 			static const double margin = 2.0;
-			std::string str = get_note_name(event.note + event.transpose);
+			std::string str = get_note_name(events.get_note(index) + events.get_transpose(index));
 			double max_width = track_width - margin * 2;
 			ImVec2 size = font->CalcTextSizeA(font->FontSize, max_width, max_width, str.c_str());
 
@@ -478,24 +500,26 @@ double Track_View_Window::draw_event(double x, double y, int position, const Tra
 	}
 
 	// draw the gap
-	if(event.off_time)
+	if(off_time)
 	{
 		border_complete = true;
 	}
 
-	// add editor cursor
-	auto editor_refs = song_manager->get_editor_refs();
-	int index = 0;
-	for(auto&& ref : event.references)
+	// add editor cursor. Reference ids can only be compared if they come from the same compile.
+	auto& editor_refs = song_manager->get_editor_refs();
+	bool editor_valid = song_manager->get_editor_generation() == snapshot->generation;
+	auto references = events.get_references(index);
+	for(auto id : references)
 	{
-		if(editor_refs.count(ref.get()))
+		if(editor_valid && editor_refs.count(id))
 		{
 			auto editor_pos = song_manager->get_editor_position();
+			auto ref = snapshot->references->get(id);
 			double cursor_y = y1;
 
 			// Set flag if we have already displayed a cursor for the current ref, and we are in a subroutine call.
-			bool jump_hack = !song_manager->get_editor_subroutine() && (event.references.size() > 1) && last_ref == ref.get();
-			last_ref = ref.get();
+			bool jump_hack = !song_manager->get_editor_subroutine() && (references.size() > 1) && last_ref == id;
+			last_ref = id;
 
 			if(     (int)ref->get_line() < editor_pos.line
 				|| ((int)ref->get_line() == editor_pos.line && (int)ref->get_column() < editor_pos.column))
@@ -508,19 +532,18 @@ double Track_View_Window::draw_event(double x, double y, int position, const Tra
 			if(!jump_hack)
 				cursor_list.push_back(ImVec2(std::floor(x1 - padding_width / 2), cursor_y));
 		}
-		index++;
 	}
 
-	return y + (event.on_time + event.off_time) * y_scale;
+	return y + (on_time + off_time) * y_scale;
 
 }
 
-void Track_View_Window::draw_event_border(double x1, double x2, double y, const Track_Info::Ext_Event& event)
+void Track_View_Window::draw_event_border(double x1, double x2, double y, const Track_Info::Event_List& events, std::size_t index)
 {
 	int border_width = y_scale * 0.55;
 
 	// draw a border before the note if we're not a slur or tie
-	if(!event.is_tie && !event.is_slur && border_width)
+	if(!events.is_tie(index) && !events.is_slur(index) && border_width)
 	{
 		draw_list->AddRectFilled(
 			ImVec2(x1,y-border_width),
@@ -532,9 +555,10 @@ void Track_View_Window::draw_event_border(double x1, double x2, double y, const
 //! Handle mouse hovering
 void Track_View_Window::hover_event(int position, const Track_Info::Ext_Event& event)
 {
-	if((hover_obj != &event) || dragging)
+	if((hover_track != draw_track) || (hover_position != position) || dragging)
 	{
-		hover_obj = &event;
+		hover_track = draw_track;
+		hover_position = position;
 		hover_time = 0;
 	}
 	else
@@ -588,6 +612,49 @@ void Track_View_Window::hover_event(int position, const Track_Info::Ext_Event& e
 	}
 }
 
+//! Show the notes sounding on all tracks when hovering the ruler
+/*!
+ *  Notes are displayed like in the event tooltip, with the transpose
+ *  shown separately.
+ */
+void Track_View_Window::hover_ruler()
+{
+	if(snapshot->timeline == nullptr || dragging)
+		return;
+
+	ImVec2 mouse_pos = ImGui::GetIO().MousePos;
+	if(!ImGui::IsItemHovered()
+		|| mouse_pos.y < canvas_pos.y + track_header_height
+		|| !ImGui::IsMouseHoveringRect(canvas_pos, ImVec2(canvas_pos.x + ruler_width, canvas_pos.y + canvas_size.y)))
+		return;
+
+	int time = y_pos + (mouse_pos.y - canvas_pos.y) / y_scale;
+	if(time < 0)
+		return;
+
+	slice_results.clear();
+	snapshot->timeline->find(time, slice_results);
+
+	ImGui::BeginTooltip();
+	ImGui::Text("t: %d", time);
+	for(auto && i : slice_results)
+	{
+		auto& events = snapshot->tracks->at(i.track_id).events;
+		uint16_t note = events.get_note(i.index);
+		int16_t transpose = events.get_transpose(i.index);
+		std::string str = "";
+		if(i.track_id < 'Z'-'A')
+			str.push_back(i.track_id + 'A');
+		else
+			str = std::to_string(i.track_id);
+		if(transpose)
+			ImGui::Text("%s: o%d%s k%d", str.c_str(), note / 12, get_note_name(note).c_str(), transpose);
+		else
+			ImGui::Text("%s: o%d%s", str.c_str(), note / 12, get_note_name(note).c_str());
+	}
+	ImGui::EndTooltip();
+}
+
 //! Get the note name
 std::string Track_View_Window::get_note_name(uint16_t note) const
 {
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "imgui.h"
 
@@ -12,6 +13,7 @@
 // todo: just get the Track_Info struct.
 // I don't want to bring all of ctrmml in the global namespace here
 #include "track_info.h"
+#include "timeline_index.h"
 
 class Track_View_Window : public Window
 {
@@ -22,6 +24,7 @@ class Track_View_Window : public Window
 
 	private:
 		const static int max_objs_per_column;
+		const static unsigned int max_spans_per_column = 64; // loop repetitions drawn per column
 		const static unsigned int measure_beat_count; //time signature (currently fixed)
 		const static unsigned int measure_beat_value;
 
@@ -41,10 +44,11 @@ class Track_View_Window : public Window
 		void draw_tracks();
 		void draw_cursors();
 
-		double draw_event(double x, double y, int position, const Track_Info::Ext_Event& event);
-		void draw_event_border(double x1, double x2, double y, const Track_Info::Ext_Event& event);
+		double draw_event(double x, double y, int position, const Track_Info::Event_List& events, std::size_t index);
+		void draw_event_border(double x1, double x2, double y, const Track_Info::Event_List& events, std::size_t index);
 
 		void hover_event(int position, const Track_Info::Ext_Event& event);
+		void hover_ruler();
 
 		std::string get_note_name(uint16_t note) const;
 
@@ -68,6 +72,7 @@ class Track_View_Window : public Window
 		double y_user; // User Y position
 
 		std::shared_ptr<Song_Manager> song_manager;
+		std::shared_ptr<const Song_Manager::Compile_Snapshot> snapshot; // compile result for the current frame
 
 		// scrolling state
 		bool hovered;
@@ -75,14 +80,17 @@ class Track_View_Window : public Window
 
 		// tooltip state
 		int hover_time;
-		const Track_Info::Ext_Event* hover_obj;
+		const Track_Info* hover_track;
+		int hover_position;
+		std::vector<Timeline_Index::Result> slice_results; // reused for the ruler tooltip
 
 		// drawing stuff
 		ImVec2 canvas_pos;
 		ImVec2 canvas_size;
 		ImDrawList* draw_list;
 		std::vector<ImVec2> cursor_list;
-		const InputRef* last_ref;
+		Ref_Pool::Id last_ref;
+		const Track_Info* draw_track; // track currently being drawn
 
 		// buffered drawing the bottom border of tied notes
 		bool border_complete;
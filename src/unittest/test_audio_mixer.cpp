@@ -0,0 +1,202 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "../audio_mixer.h"
+
+// Set on the fake audio driver thread
+static thread_local bool is_audio_thread = false;
+static std::atomic<int> stopped_streams;
+static std::atomic<int> released_on_audio_thread;
+static std::atomic<int> logged_streams;
+static std::atomic<int> logged_on_audio_thread;
+
+// Stream that outputs a fixed number of samples with the value 1.
+class Test_Stream : public Audio_Stream
+{
+	public:
+		Test_Stream(int length)
+			: remaining(length)
+		{}
+
+		~Test_Stream()
+		{
+			if(is_audio_thread)
+				released_on_audio_thread++;
+		}
+
+		void setup_stream(uint32_t sample_rate) override
+		{
+		}
+
+		int get_sample(WAVE_32BS* output, int count, int channels) override
+		{
+			for(int i = 0; i < count && remaining; i++, remaining--)
+			{
+				output[i].L += 1 << 8;
+				output[i].R += 1 << 8;
+			}
+			if(!remaining)
+				set_finished(true);
+			return count;
+		}
+
+		void stop_stream() override
+		{
+			stopped_streams++;
+		}
+
+		void log_events() override
+		{
+			logged_streams++;
+			if(is_audio_thread)
+				logged_on_audio_thread++;
+		}
+
+	private:
+		int remaining;
+};
+
+class Audio_Mixer_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Audio_Mixer_Test);
+	CPPUNIT_TEST(test_mix);
+	CPPUNIT_TEST(test_stop);
+	CPPUNIT_TEST(test_volume);
+	CPPUNIT_TEST(test_stress);
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void setUp()
+	{
+		stopped_streams = 0;
+		released_on_audio_thread = 0;
+		logged_streams = 0;
+		logged_on_audio_thread = 0;
+	}
+	void tearDown()
+	{
+	}
+	void test_mix()
+	{
+		Audio_Mixer mixer(64, 4);
+		CPPUNIT_ASSERT(mixer.add_stream(std::make_shared<Test_Stream>(100)));
+		CPPUNIT_ASSERT(mixer.add_stream(std::make_shared<Test_Stream>(10)));
+
+		const WAVE_32BS* buffer = mixer.mix(64);
+		CPPUNIT_ASSERT_EQUAL(2 << 8, buffer[0].L);
+		CPPUNIT_ASSERT_EQUAL(2 << 8, buffer[9].R);
+		CPPUNIT_ASSERT_EQUAL(1 << 8, buffer[10].L);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, mixer.collect());
+
+		buffer = mixer.mix(64);
+		CPPUNIT_ASSERT_EQUAL(1 << 8, buffer[35].L);
+		CPPUNIT_ASSERT_EQUAL(0, buffer[36].L);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, mixer.collect());
+
+		buffer = mixer.mix(64);
+		CPPUNIT_ASSERT_EQUAL(0, buffer[0].L);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, mixer.collect());
+	}
+	void test_stop()
+	{
+		// A stream stopped from another thread is not mixed anymore.
+		Audio_Mixer mixer(64, 4);
+		auto stream = std::make_shared<Test_Stream>(1000);
+		mixer.add_stream(stream);
+		mixer.mix(64);
+		stream->set_finished(true);
+		const WAVE_32BS* buffer = mixer.mix(64);
+		CPPUNIT_ASSERT_EQUAL(0, buffer[0].L);
+		CPPUNIT_ASSERT_EQUAL(0, (int)logged_streams);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, mixer.collect());
+		CPPUNIT_ASSERT_EQUAL(1, (int)logged_streams);
+
+		// The queue is full until streams are started by the audio thread.
+		for(int i = 0; i < 4; i++)
+			CPPUNIT_ASSERT(mixer.add_stream(std::make_shared<Test_Stream>(1)));
+		CPPUNIT_ASSERT(!mixer.add_stream(std::make_shared<Test_Stream>(1)));
+		mixer.mix(64);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)4, mixer.collect());
+	}
+	void test_volume()
+	{
+		Audio_Mixer mixer(512, 4);
+		mixer.add_stream(std::make_shared<Test_Stream>(100000));
+
+		// Only the latest volume is used, and it is ramped in.
+		CPPUNIT_ASSERT(mixer.set_volume(Audio_Mixer::unity_gain / 2));
+		CPPUNIT_ASSERT(mixer.set_volume(0));
+		const WAVE_32BS* buffer = mixer.mix(512);
+		CPPUNIT_ASSERT(buffer[0].L > 0 && buffer[0].L < 1 << 8);
+		for(int i = 1; i < Audio_Mixer::volume_ramp_length; i++)
+			CPPUNIT_ASSERT(buffer[i].L <= buffer[i - 1].L);
+		CPPUNIT_ASSERT(buffer[Audio_Mixer::volume_ramp_length / 2].L > 0);
+		CPPUNIT_ASSERT_EQUAL(0, buffer[Audio_Mixer::volume_ramp_length - 1].L);
+		CPPUNIT_ASSERT_EQUAL(0, buffer[511].R);
+
+		// The ramp continues across mix() calls.
+		CPPUNIT_ASSERT(mixer.set_volume(Audio_Mixer::unity_gain));
+		buffer = mixer.mix(100);
+		CPPUNIT_ASSERT(buffer[99].L < 1 << 8);
+		buffer = mixer.mix(512);
+		CPPUNIT_ASSERT(buffer[0].L < 1 << 8);
+		CPPUNIT_ASSERT_EQUAL(1 << 8, buffer[Audio_Mixer::volume_ramp_length - 100 - 1].L);
+		CPPUNIT_ASSERT_EQUAL(1 << 8, buffer[511].L);
+	}
+	void test_stress()
+	{
+		// Add streams as fast as possible while a fake audio driver pulls buffers.
+		const int stream_count = 2000;
+		Audio_Mixer mixer(256, 8);
+		std::atomic<bool> done(false);
+		std::atomic<int64_t> mixed_samples(0);
+
+		std::thread audio_thread([&]()
+		{
+			is_audio_thread = true;
+			const unsigned int sizes[] = {256, 1, 64, 100, 7};
+			int64_t total = 0;
+			for(unsigned int i = 0; !done; i++)
+			{
+				unsigned int count = sizes[i % 5];
+				const WAVE_32BS* buffer = mixer.mix(count);
+				for(unsigned int j = 0; j < count; j++)
+					total += buffer[j].L >> 8;
+			}
+			mixed_samples = total;
+		});
+
+		int64_t expected_samples = 0;
+		int released = 0;
+		for(int i = 0; i < stream_count; i++)
+		{
+			int length = 1 + (i * 37) % 500;
+			expected_samples += length;
+			auto stream = std::make_shared<Test_Stream>(length);
+			while(!mixer.add_stream(stream))
+			{
+				released += mixer.collect();
+				std::this_thread::yield();
+			}
+			released += mixer.collect();
+		}
+
+		auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+		while(released < stream_count && std::chrono::steady_clock::now() < timeout)
+		{
+			released += mixer.collect();
+			std::this_thread::yield();
+		}
+		done = true;
+		audio_thread.join();
+
+		CPPUNIT_ASSERT_EQUAL(stream_count, released);
+		CPPUNIT_ASSERT_EQUAL(stream_count, (int)stopped_streams);
+		CPPUNIT_ASSERT_EQUAL(expected_samples, (int64_t)mixed_samples);
+		CPPUNIT_ASSERT_EQUAL(0, (int)released_on_audio_thread);
+		CPPUNIT_ASSERT_EQUAL(0, (int)logged_on_audio_thread);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Audio_Mixer_Test);
@@ -0,0 +1,125 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <climits>
+#include <string>
+#include <vector>
+#include "../length_table.h"
+#include "../cursor_index.h"
+#include "song.h"
+#include "input.h"
+#include "mml_input.h"
+
+class Cursor_Index_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Cursor_Index_Test);
+	CPPUNIT_TEST(test_notes);
+	CPPUNIT_TEST(test_multiple_lines);
+	CPPUNIT_TEST(test_loops);
+	CPPUNIT_TEST(test_subroutines);
+	CPPUNIT_TEST(test_empty_line);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	Song *song;
+	MML_Input *mml_input;
+	std::vector<std::string> lines;
+	std::vector<MML_Input::Track_Position_Map> line_map;
+
+	void read(const std::string& str)
+	{
+		mml_input->read_line(str, lines.size());
+		lines.push_back(str);
+		line_map.push_back(mml_input->get_track_map());
+	}
+
+	// Compare the index with the scanning code at every cursor position.
+	void compare_all()
+	{
+		Length_Table lengths(*song);
+		Cursor_Index index(*song, lengths);
+
+		for(unsigned int line = 0; line < lines.size(); line++)
+		{
+			for(auto && i : line_map[line])
+			{
+				CPPUNIT_ASSERT(index.is_indexed(i.first));
+				for(int column = 0; column <= (int)lines[line].size() + 1; column++)
+				{
+					auto expected = Cursor_Index::scan(song->get_track(i.first), i.first, lengths, i.second, line, column);
+					auto actual = index.find(i.first, i.second, line, column);
+					CPPUNIT_ASSERT_EQUAL(expected.reference, actual.reference);
+					CPPUNIT_ASSERT_EQUAL(expected.cursor_time, actual.cursor_time);
+					CPPUNIT_ASSERT_EQUAL(expected.line_time, actual.line_time);
+				}
+			}
+		}
+	}
+public:
+	void setUp()
+	{
+		song = new Song();
+		mml_input = new MML_Input(song);
+		lines.clear();
+		line_map.clear();
+	}
+	void tearDown()
+	{
+		delete mml_input;
+		delete song;
+	}
+	void test_notes()
+	{
+		read("A c4 d8 r8 e2 &e4 ^8 @2 v12 f4");
+		compare_all();
+
+		Length_Table lengths(*song);
+		Cursor_Index index(*song, lengths);
+		auto position = line_map[0].at(0);
+		// cursor before "d8"
+		auto result = index.find(0, position, 0, 5);
+		CPPUNIT_ASSERT(result.reference != nullptr);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)24, result.cursor_time);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, result.line_time);
+	}
+	void test_multiple_lines()
+	{
+		read("A l8 cdef");
+		read("B o3 c4 c4");
+		read("AB gab>c");
+		read("A c2 d2");
+		read("B r1");
+		compare_all();
+	}
+	void test_loops()
+	{
+		read("A [cd]2 e4");
+		read("A [c / d e]3 f");
+		read("A [[c8]2 d4]2");
+		read("A L c4 d4");
+		compare_all();
+	}
+	void test_subroutines()
+	{
+		read("*30 c8 d8");
+		read("*31 [*30]2 e4");
+		read("A *30 c4 *31");
+		read("A [*30 / r4]2");
+		read("*32 [c4]3");
+		read("A *32 d4");
+		compare_all();
+	}
+	void test_empty_line()
+	{
+		read("A c4");
+		read("");
+		read("; comment");
+		read("A d4");
+		compare_all();
+
+		Length_Table lengths(*song);
+		Cursor_Index index(*song, lengths);
+		auto result = index.find(1, 0, 0, 0);
+		CPPUNIT_ASSERT(result.reference == nullptr);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)UINT_MAX, result.cursor_time);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Cursor_Index_Test);
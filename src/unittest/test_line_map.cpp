@@ -0,0 +1,100 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include "../line_map.h"
+#include "song.h"
+#include "input.h"
+#include "mml_input.h"
+
+class Line_Map_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Line_Map_Test);
+	CPPUNIT_TEST(test_tracks);
+	CPPUNIT_TEST(test_empty_lines);
+	CPPUNIT_TEST(test_subroutines);
+	CPPUNIT_TEST(test_out_of_range);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	Song *song;
+	MML_Input *mml_input;
+	Line_Map *line_map;
+	std::vector<MML_Input::Track_Position_Map> expected;
+
+	void read(const std::string& str)
+	{
+		int line = expected.size();
+		mml_input->read_line(str, line);
+		expected.push_back(mml_input->get_track_map());
+		line_map->insert(line, mml_input->get_track_map());
+	}
+
+	// Compare the map with the track positions from the parser at every line.
+	void compare_all()
+	{
+		CPPUNIT_ASSERT_EQUAL((int)expected.size(), line_map->get_line_count());
+		for(unsigned int line = 0; line < expected.size(); line++)
+		{
+			auto actual = line_map->at(line);
+			CPPUNIT_ASSERT_EQUAL(expected[line].size(), actual.size());
+			CPPUNIT_ASSERT(expected[line] == actual);
+		}
+	}
+public:
+	void setUp()
+	{
+		song = new Song();
+		mml_input = new MML_Input(song);
+		line_map = new Line_Map();
+		expected.clear();
+	}
+	void tearDown()
+	{
+		delete line_map;
+		delete mml_input;
+		delete song;
+	}
+	void test_tracks()
+	{
+		read("A l8 cdef");
+		read("B o3 c4 c4");
+		read("AB gab>c");
+		read("A c2 d2");
+		read("B r1");
+		read("ABC c");
+		compare_all();
+
+		// track B is not on line 3
+		CPPUNIT_ASSERT_EQUAL((std::size_t)0, line_map->at(3).count(1));
+	}
+	void test_empty_lines()
+	{
+		read("A c4");
+		read("");
+		read("; comment");
+		read("A d4");
+		compare_all();
+	}
+	void test_subroutines()
+	{
+		read("*30 c8 d8");
+		read("A *30 c4");
+		read("*31 [*30]2 e4");
+		read("A [*31 / r4]2");
+		compare_all();
+	}
+	void test_out_of_range()
+	{
+		read("A c4");
+		CPPUNIT_ASSERT(line_map->at(-1).empty());
+		CPPUNIT_ASSERT(line_map->at(1).empty());
+
+		// skipped lines have no positions
+		line_map->insert(3, mml_input->get_track_map());
+		CPPUNIT_ASSERT_EQUAL(4, line_map->get_line_count());
+		CPPUNIT_ASSERT(line_map->at(1).empty());
+		CPPUNIT_ASSERT(line_map->at(2).empty());
+		CPPUNIT_ASSERT(line_map->at(3) == line_map->at(0));
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Line_Map_Test);
@@ -0,0 +1,158 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <climits>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../sample_converter.h"
+
+class Sample_Converter_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Sample_Converter_Test);
+	CPPUNIT_TEST(test_s16);
+	CPPUNIT_TEST(test_s24);
+	CPPUNIT_TEST(test_f32);
+	CPPUNIT_TEST(test_gain);
+	CPPUNIT_TEST(test_simd_matches_scalar);
+	CPPUNIT_TEST(test_channels);
+	CPPUNIT_TEST(test_format_names);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	// Random samples, mostly in range but some clipping, including the extremes.
+	static std::vector<WAVE_32BS> make_samples(unsigned int count)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int32_t> dist(-(1 << 24), 1 << 24);
+		std::vector<WAVE_32BS> samples(count);
+		for(auto && i : samples)
+			i = {dist(rng), dist(rng)};
+		if(count > 2)
+		{
+			samples[0] = {INT32_MAX, INT32_MIN};
+			samples[1] = {-1, 255};
+			samples[count - 1] = {INT32_MIN, INT32_MAX};
+		}
+		return samples;
+	}
+public:
+	void setUp()
+	{
+	}
+	void tearDown()
+	{
+	}
+	void test_s16()
+	{
+		WAVE_32BS input[5] = {{0, 1 << 8}, {-1, -256}, {0x7fff00, 0x800000}, {-0x800000, -0x800100}, {0x1234ff, 0}};
+		int16_t output[10];
+		Sample_Converter::to_s16(input, output, 5);
+		const int16_t expected[10] = {0, 1, -1, -1, 0x7fff, 0x7fff, -0x8000, -0x8000, 0x1234, 0};
+		for(int i = 0; i < 10; i++)
+			CPPUNIT_ASSERT_EQUAL(expected[i], output[i]);
+	}
+	void test_s24()
+	{
+		WAVE_32BS input[3] = {{0x123456, -1}, {0x800000, -0x800001}, {-0x800000, 0x7fffff}};
+		uint8_t output[18];
+		Sample_Converter::to_s24(input, output, 3);
+		const uint8_t expected[18] = {
+			0x56, 0x34, 0x12, 0xff, 0xff, 0xff,
+			0xff, 0xff, 0x7f, 0x00, 0x00, 0x80,
+			0x00, 0x00, 0x80, 0xff, 0xff, 0x7f};
+		for(int i = 0; i < 18; i++)
+			CPPUNIT_ASSERT_EQUAL((int)expected[i], (int)output[i]);
+	}
+	void test_f32()
+	{
+		WAVE_32BS input[3] = {{0, 0x400000}, {-0x800000, 0x1000000}, {-0x2000000, -0x200000}};
+		float output[6];
+		Sample_Converter::to_f32(input, output, 3);
+		const float expected[6] = {0.0f, 0.5f, -1.0f, 1.0f, -1.0f, -0.25f};
+		for(int i = 0; i < 6; i++)
+			CPPUNIT_ASSERT_EQUAL(expected[i], output[i]);
+	}
+	void test_gain()
+	{
+		WAVE_32BS samples[3] = {{1000, -1000}, {-1, 1}, {INT32_MAX, INT32_MIN}};
+		Sample_Converter::apply_gain(samples, 3, 0x8000);
+		CPPUNIT_ASSERT_EQUAL(500, samples[0].L);
+		CPPUNIT_ASSERT_EQUAL(-500, samples[0].R);
+		CPPUNIT_ASSERT_EQUAL(-1, samples[1].L);
+		CPPUNIT_ASSERT_EQUAL(0, samples[1].R);
+		CPPUNIT_ASSERT_EQUAL(INT32_MAX / 2, samples[2].L);
+		CPPUNIT_ASSERT_EQUAL(INT32_MIN / 2, samples[2].R);
+	}
+	void test_simd_matches_scalar()
+	{
+		// Odd counts also test the scalar tail of the SIMD kernels.
+		for(unsigned int count : {0u, 1u, 2u, 3u, 4u, 5u, 7u, 1001u})
+		{
+			auto input = make_samples(count);
+
+			std::vector<int16_t> s16(count * 2 + 1), s16_ref(count * 2 + 1);
+			Sample_Converter::to_s16(input.data(), s16.data(), count);
+			Sample_Converter::to_s16_scalar(input.data(), s16_ref.data(), count);
+			CPPUNIT_ASSERT(s16 == s16_ref);
+
+			std::vector<uint8_t> s24(count * 6 + 1), s24_ref(count * 6 + 1);
+			Sample_Converter::to_s24(input.data(), s24.data(), count);
+			Sample_Converter::to_s24_scalar(input.data(), s24_ref.data(), count);
+			CPPUNIT_ASSERT(s24 == s24_ref);
+
+			std::vector<float> f32(count * 2 + 1), f32_ref(count * 2 + 1);
+			Sample_Converter::to_f32(input.data(), f32.data(), count);
+			Sample_Converter::to_f32_scalar(input.data(), f32_ref.data(), count);
+			CPPUNIT_ASSERT(f32 == f32_ref);
+
+			for(int32_t gain : {0, 1, 0x8000, 0x10000, 0x1ffff, INT32_MAX})
+			{
+				auto a = input, b = input;
+				Sample_Converter::apply_gain(a.data(), count, gain);
+				Sample_Converter::apply_gain_scalar(b.data(), count, gain);
+				for(unsigned int i = 0; i < count; i++)
+				{
+					CPPUNIT_ASSERT_EQUAL(b[i].L, a[i].L);
+					CPPUNIT_ASSERT_EQUAL(b[i].R, a[i].R);
+				}
+			}
+		}
+	}
+	void test_channels()
+	{
+		WAVE_32BS input[2] = {{0x100, 0x300}, {-0x100, 0x7fffff00}};
+
+		Sample_Converter mono(Sample_Converter::S16, 1);
+		CPPUNIT_ASSERT_EQUAL(2u, mono.get_frame_size());
+		int16_t mono_output[2];
+		mono.convert(input, mono_output, 2);
+		CPPUNIT_ASSERT_EQUAL((int16_t)2, mono_output[0]);
+		CPPUNIT_ASSERT_EQUAL((int16_t)0x7fff, mono_output[1]);
+
+		Sample_Converter quad(Sample_Converter::F32, 4);
+		CPPUNIT_ASSERT_EQUAL(16u, quad.get_frame_size());
+		float quad_output[8];
+		std::memset(quad_output, 0xff, sizeof(quad_output));
+		quad.convert(input, quad_output, 2);
+		CPPUNIT_ASSERT_EQUAL(0x100 * (1.0f / 8388608.0f), quad_output[0]);
+		CPPUNIT_ASSERT_EQUAL(0x300 * (1.0f / 8388608.0f), quad_output[1]);
+		CPPUNIT_ASSERT_EQUAL(0.0f, quad_output[2]);
+		CPPUNIT_ASSERT_EQUAL(0.0f, quad_output[3]);
+		CPPUNIT_ASSERT_EQUAL(-0x100 * (1.0f / 8388608.0f), quad_output[4]);
+		CPPUNIT_ASSERT_EQUAL(1.0f, quad_output[5]);
+		CPPUNIT_ASSERT_EQUAL(0.0f, quad_output[7]);
+
+		Sample_Converter stereo(Sample_Converter::S24, 2);
+		CPPUNIT_ASSERT_EQUAL(6u, stereo.get_frame_size());
+	}
+	void test_format_names()
+	{
+		Sample_Converter::Format format = Sample_Converter::S16;
+		CPPUNIT_ASSERT(Sample_Converter::find_format("f32", format));
+		CPPUNIT_ASSERT_EQUAL((int)Sample_Converter::F32, (int)format);
+		CPPUNIT_ASSERT(Sample_Converter::find_format("s24", format));
+		CPPUNIT_ASSERT_EQUAL((int)Sample_Converter::S24, (int)format);
+		CPPUNIT_ASSERT(!Sample_Converter::find_format("u8", format));
+		CPPUNIT_ASSERT_EQUAL((int)Sample_Converter::S24, (int)format);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Sample_Converter_Test);
@@ -0,0 +1,148 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "../step_timer.h"
+
+class Step_Timer_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Step_Timer_Test);
+	CPPUNIT_TEST(test_first_step);
+	CPPUNIT_TEST(test_blocks);
+	CPPUNIT_TEST(test_no_drift);
+	CPPUNIT_TEST(test_no_drift_fraction);
+	CPPUNIT_TEST(test_inexact_step);
+	CPPUNIT_TEST(test_zero_step);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	// Run the timer like Emu_Player does, skipping ahead to the next step.
+	// Returns the sample index of each step if steps is set.
+	static void run_blocks(Step_Timer& timer, double step, uint64_t samples, std::vector<uint64_t>* steps = nullptr)
+	{
+		uint64_t position = 0;
+		while(position < samples)
+		{
+			timer.advance(1);
+			while(timer.step_due())
+			{
+				if(steps)
+					steps->push_back(position);
+				timer.add_step(step);
+			}
+			uint64_t remaining = std::min<uint64_t>(samples - position - 1, UINT32_MAX);
+			uint32_t idle = timer.get_idle_samples(remaining);
+			timer.advance(idle);
+			position += 1 + idle;
+		}
+	}
+
+	// Run the timer one sample at a time.
+	static void run_samples(Step_Timer& timer, double step, uint64_t samples, std::vector<uint64_t>* steps)
+	{
+		for(uint64_t position = 0; position < samples; position++)
+		{
+			timer.advance(1);
+			while(timer.step_due())
+			{
+				steps->push_back(position);
+				timer.add_step(step);
+			}
+		}
+	}
+public:
+	void test_first_step()
+	{
+		Step_Timer timer;
+		timer.set_sample_rate(44100);
+		CPPUNIT_ASSERT_EQUAL(false, timer.step_due());
+		timer.advance(1);
+		CPPUNIT_ASSERT_EQUAL(true, timer.step_due());
+		timer.add_step(1.0 / 60.0);
+		CPPUNIT_ASSERT_EQUAL(false, timer.step_due());
+		// 735 samples per step, the next step is due at sample 735
+		CPPUNIT_ASSERT_EQUAL((uint32_t)734, timer.get_idle_samples(1000));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)100, timer.get_idle_samples(100));
+		timer.advance(734);
+		CPPUNIT_ASSERT_EQUAL(false, timer.step_due());
+		timer.advance(1);
+		CPPUNIT_ASSERT_EQUAL(true, timer.step_due());
+	}
+	void test_blocks()
+	{
+		// Skipping ahead must give the same steps as running each sample.
+		const double steps[] = {1.0 / 60.0, 1001.0 / 60000.0, 0.0123456, 1.0 / 44100.0};
+		for(double step : steps)
+		{
+			Step_Timer a, b;
+			a.set_sample_rate(44100);
+			b.set_sample_rate(44100);
+			std::vector<uint64_t> block_steps, sample_steps;
+			run_blocks(a, step, 44100 * 10, &block_steps);
+			run_samples(b, step, 44100 * 10, &sample_steps);
+			CPPUNIT_ASSERT(block_steps == sample_steps);
+			CPPUNIT_ASSERT_EQUAL(b.get_sample_count(), a.get_sample_count());
+		}
+	}
+	void test_no_drift()
+	{
+		// 10 hours at 60 Hz and 50 Hz. The steps are a whole number of samples.
+		const uint64_t hours = 10;
+		Step_Timer timer;
+		timer.set_sample_rate(44100);
+		run_blocks(timer, 1.0 / 60.0, 44100 * 3600 * hours);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(60 * 3600 * hours), timer.get_step_count());
+		// the next step is due exactly at the next sample
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0, timer.get_idle_samples(UINT32_MAX));
+		timer.advance(1);
+		CPPUNIT_ASSERT_EQUAL(true, timer.step_due());
+
+		timer.set_sample_rate(48000);
+		run_blocks(timer, 1.0 / 50.0, 48000 * 3600 * hours);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(50 * 3600 * hours), timer.get_step_count());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0, timer.get_idle_samples(UINT32_MAX));
+		timer.advance(1);
+		CPPUNIT_ASSERT_EQUAL(true, timer.step_due());
+	}
+	void test_no_drift_fraction()
+	{
+		// 1/64 second at 44100 Hz is 689.0625 samples, which is exact in fixed point.
+		// Step k (counting from 0) is due at sample floor(k * 689.0625).
+		const uint64_t samples = (uint64_t)44100 * 3600 * 10;
+		Step_Timer timer;
+		timer.set_sample_rate(44100);
+		std::vector<uint64_t> steps;
+		run_blocks(timer, 1.0 / 64.0, samples, &steps);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)(64 * 3600 * 10), timer.get_step_count());
+		for(uint64_t k = 0; k < steps.size(); k++)
+			CPPUNIT_ASSERT_EQUAL(k * 11025 / 16, steps[k]);
+	}
+	void test_inexact_step()
+	{
+		// 1001/60000 second at 48000 Hz is 800.8 samples, which is rounded to
+		// the nearest 1/2^32 sample. After 10 hours the error must still be
+		// less than one step.
+		const uint64_t samples = (uint64_t)48000 * 3600 * 10;
+		Step_Timer timer;
+		timer.set_sample_rate(48000);
+		run_blocks(timer, 1001.0 / 60000.0, samples);
+		uint64_t expected = (samples * 5 + 4003) / 4004;
+		CPPUNIT_ASSERT(timer.get_step_count() + 1 >= expected);
+		CPPUNIT_ASSERT(timer.get_step_count() <= expected + 1);
+
+		// Both runs must give the same result.
+		Step_Timer timer2;
+		timer2.set_sample_rate(48000);
+		run_blocks(timer2, 1001.0 / 60000.0, samples);
+		CPPUNIT_ASSERT_EQUAL(timer.get_step_count(), timer2.get_step_count());
+	}
+	void test_zero_step()
+	{
+		// A step of zero length must not stall the timer.
+		Step_Timer timer;
+		timer.set_sample_rate(44100);
+		run_blocks(timer, 0.0, 100);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)100, timer.get_step_count());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Step_Timer_Test);
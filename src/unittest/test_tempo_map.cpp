@@ -0,0 +1,117 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <map>
+#include <climits>
+#include "../track_info.h"
+#include "../tempo_map.h"
+#include "song.h"
+#include "input.h"
+#include "mml_input.h"
+
+class Tempo_Map_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Tempo_Map_Test);
+	CPPUNIT_TEST(test_default_tempo);
+	CPPUNIT_TEST(test_tempo_changes);
+	CPPUNIT_TEST(test_loop);
+	CPPUNIT_TEST(test_is_current);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	Song *song;
+	MML_Input *mml_input;
+	Ref_Pool *ref_pool;
+	std::map<int, Track_Info> tracks;
+
+	void generate()
+	{
+		tracks.clear();
+		for(auto && i : song->get_track_map())
+			tracks.emplace(i.first, Track_Info_Generator(*song, i.second, *ref_pool));
+	}
+public:
+	void setUp()
+	{
+		song = new Song();
+		mml_input = new MML_Input(song);
+		ref_pool = new Ref_Pool();
+	}
+	void tearDown()
+	{
+		tracks.clear();
+		delete ref_pool;
+		delete mml_input;
+		delete song;
+	}
+	void test_default_tempo()
+	{
+		mml_input->read_line("A c4 d4");
+		generate();
+
+		Tempo_Map map(tracks, 24);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, map.size());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, map.get_seconds(24), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(48.0, map.get_ticks(1.0), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(Tempo_Map::default_bpm, map.get_bpm(1000), 1e-9);
+	}
+	void test_tempo_changes()
+	{
+		mml_input->read_line("A t150 c4 c4 t75 c4 c4");
+		mml_input->read_line("B c4 t150 c4");
+		generate();
+
+		// 150 BPM until tick 48, then 75 BPM. The tempo command in B at tick 24 changes nothing.
+		Tempo_Map map(tracks, 24);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, map.size());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(0.2, map.get_seconds(12), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(0.8, map.get_seconds(48), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(1.6, map.get_seconds(72), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(75.0, map.get_bpm(48), 1e-9);
+		for(int ticks = 0; ticks < 200; ticks += 7)
+			CPPUNIT_ASSERT_DOUBLES_EQUAL((double)ticks, map.get_ticks(map.get_seconds(ticks)), 1e-6);
+	}
+	void test_loop()
+	{
+		mml_input->read_line("A c4 L t150 c4 t75 c4");
+		mml_input->read_line("B c1 c1");
+		generate();
+
+		// The loop of A is repeated until the end of B at tick 192.
+		Tempo_Map map(tracks, 24);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, map.get_bpm(72), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(75.0, map.get_bpm(96), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, map.get_bpm(120), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, map.get_bpm(180), 1e-9);
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(120.0, map.get_bpm(0), 1e-9);
+	}
+	void test_is_current()
+	{
+		mml_input->read_line("A t150 c1 c1 t75 c1");
+		mml_input->read_line("B c1 c1 c1 L t120 c1");
+		Track_Info_Generator gen_a(*song, song->get_track(0), *ref_pool, 50);
+		Track_Info_Generator gen_b(*song, song->get_track(1), *ref_pool, 50);
+		auto collect = [&]()
+		{
+			tracks.clear();
+			tracks.emplace(0, gen_a);
+			tracks.emplace(1, gen_b);
+		};
+		collect();
+		Tempo_Map map(tracks, 24);
+
+		// no new tempo commands
+		gen_a.generate(150);
+		gen_b.generate(150);
+		collect();
+		CPPUNIT_ASSERT(map.is_current(tracks));
+
+		// tempo command in A at tick 192, loop of B with a tempo command at tick 288
+		gen_a.generate(UINT_MAX);
+		gen_b.generate(UINT_MAX);
+		collect();
+		CPPUNIT_ASSERT(!map.is_current(tracks));
+		Tempo_Map complete_map(tracks, 24);
+		CPPUNIT_ASSERT(complete_map.is_current(tracks));
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(75.0, complete_map.get_bpm(200), 1e-9);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Tempo_Map_Test);
@@ -0,0 +1,170 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include "../track_info.h"
+#include "../timeline_index.h"
+#include "song.h"
+#include "input.h"
+#include "mml_input.h"
+
+class Timeline_Index_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Timeline_Index_Test);
+	CPPUNIT_TEST(test_point);
+	CPPUNIT_TEST(test_range);
+	CPPUNIT_TEST(test_loops);
+	CPPUNIT_TEST(test_empty);
+	CPPUNIT_TEST(test_extend);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	Song *song;
+	MML_Input *mml_input;
+	Ref_Pool *ref_pool;
+	std::map<int, Track_Info> tracks;
+
+	void generate()
+	{
+		tracks.clear();
+		for(auto && i : song->get_track_map())
+			tracks.emplace(i.first, Track_Info_Generator(*song, i.second, *ref_pool));
+	}
+
+	static void sort(std::vector<Timeline_Index::Result>& results)
+	{
+		std::sort(results.begin(), results.end(), [](const Timeline_Index::Result& a, const Timeline_Index::Result& b)
+		{
+			return std::make_tuple(a.track_id, a.index, a.offset) < std::make_tuple(b.track_id, b.index, b.offset);
+		});
+	}
+
+	// Compare the index with scanning every track for each range.
+	void compare_all(int length, int range)
+	{
+		compare_all(Timeline_Index(tracks), length, range);
+	}
+	void compare_all(const Timeline_Index& index, int length, int range)
+	{
+		for(int start = 0; start < length; start++)
+		{
+			std::vector<Timeline_Index::Result> expected, actual;
+			Timeline_Index::scan(tracks, start, start + range, expected);
+			unsigned int count = index.find(start, start + range, actual);
+			CPPUNIT_ASSERT_EQUAL((unsigned int)actual.size(), count);
+			sort(expected);
+			sort(actual);
+			CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+			for(unsigned int i = 0; i < expected.size(); i++)
+			{
+				CPPUNIT_ASSERT_EQUAL(expected[i].track_id, actual[i].track_id);
+				CPPUNIT_ASSERT_EQUAL(expected[i].index, actual[i].index);
+				CPPUNIT_ASSERT_EQUAL(expected[i].offset, actual[i].offset);
+			}
+		}
+	}
+public:
+	void setUp()
+	{
+		song = new Song();
+		mml_input = new MML_Input(song);
+		ref_pool = new Ref_Pool();
+	}
+	void tearDown()
+	{
+		tracks.clear();
+		delete ref_pool;
+		delete mml_input;
+		delete song;
+	}
+	void test_point()
+	{
+		mml_input->read_line("A c1 d2 r2 e4");
+		mml_input->read_line("B c4 d4 e4 f4 g2 r4 a4");
+		mml_input->read_line("C r2 c2");
+		generate();
+
+		Timeline_Index index(tracks);
+		std::vector<Timeline_Index::Result> results;
+		// A: c1 (0-96), B: c4 (0-24)
+		CPPUNIT_ASSERT_EQUAL((unsigned int)2, index.find(0, results));
+		// A: c1, B: f4 (72-96), C: c2 (48-...)
+		results.clear();
+		CPPUNIT_ASSERT_EQUAL((unsigned int)3, index.find(72, results));
+		// A: rest, B: rest, C: nothing
+		results.clear();
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, index.find(152, results));
+		// A: e4 (192-216)
+		results.clear();
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, index.find(200, results));
+		CPPUNIT_ASSERT_EQUAL(0, results[0].track_id);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)3, results[0].index);
+		CPPUNIT_ASSERT_EQUAL(0, results[0].offset);
+
+		compare_all(240, 1);
+	}
+	void test_range()
+	{
+		mml_input->read_line("A l8 cdefgab>c");
+		mml_input->read_line("B c1");
+		mml_input->read_line("C r4 c16d16 r8 e2");
+		generate();
+		compare_all(120, 7);
+		compare_all(120, 48);
+	}
+	void test_loops()
+	{
+		mml_input->read_line("A c4 L d8 e8");
+		mml_input->read_line("B c2 d2 e2");
+		mml_input->read_line("C r4 L [c16 r16]2 d4");
+		generate();
+		compare_all(600, 1);
+		compare_all(600, 20);
+	}
+	void test_empty()
+	{
+		mml_input->read_line("A r1");
+		generate();
+
+		Timeline_Index index(tracks);
+		std::vector<Timeline_Index::Result> results;
+		CPPUNIT_ASSERT_EQUAL((std::size_t)0, index.size());
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, index.find(0, 100, results));
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, index.find(50, 40, results));
+	}
+	void test_extend()
+	{
+		mml_input->read_line("A c4 L d8 e8 f2");
+		mml_input->read_line("B c2 d2 e2 f1");
+		mml_input->read_line("C r4 [c16 r16]8 d4 e1");
+		std::vector<std::pair<int, std::unique_ptr<Track_Info_Generator>>> generators;
+		for(auto && i : song->get_track_map())
+			generators.emplace_back(i.first, std::make_unique<Track_Info_Generator>(*song, i.second, *ref_pool, 30));
+
+		auto collect = [&]()
+		{
+			tracks.clear();
+			for(auto && i : generators)
+				tracks.emplace(i.first, *i.second);
+		};
+		collect();
+		auto first_tracks = tracks;
+		Timeline_Index first(tracks);
+		std::unique_ptr<Timeline_Index> index(new Timeline_Index(first, tracks));
+		for(unsigned int end_time = 60; end_time < 600; end_time += 30)
+		{
+			for(auto && i : generators)
+				i.second->generate(end_time);
+			collect();
+			index.reset(new Timeline_Index(*index, tracks));
+			compare_all(*index, end_time + 100, 10);
+		}
+
+		// The index of the first pass is not changed by extending it.
+		tracks = first_tracks;
+		compare_all(first, 100, 10);
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Timeline_Index_Test);
@@ -1,6 +1,8 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <exception>
 #include <cstdio>
+#include <climits>
+#include <algorithm>
 #include "../track_info.h"
 #include "song.h"
 #include "input.h"
@@ -11,25 +13,40 @@ class Track_Info_Test : public CppUnit::TestFixture
 	CPPUNIT_TEST_SUITE(Track_Info_Test);
 	CPPUNIT_TEST(test_generator);
 	CPPUNIT_TEST(test_drum_mode);
+	CPPUNIT_TEST(test_reference_pool);
+	CPPUNIT_TEST(test_reference_pool_shared);
+	CPPUNIT_TEST(test_reference_pool_many);
+	CPPUNIT_TEST(test_event_accessors);
+	CPPUNIT_TEST(test_range);
+	CPPUNIT_TEST(test_range_loop);
+	CPPUNIT_TEST(test_range_zero_length_loop);
+	CPPUNIT_TEST(test_range_max_spans);
+	CPPUNIT_TEST(test_generate_passes);
+	CPPUNIT_TEST(test_compare);
+	CPPUNIT_TEST(test_compare_loop);
+	CPPUNIT_TEST(test_compare_tempo);
 	CPPUNIT_TEST_SUITE_END();
 private:
 	Song *song;
 	MML_Input *mml_input;
+	Ref_Pool *ref_pool;
 public:
 	void setUp()
 	{
 		song = new Song();
 		mml_input = new MML_Input(song);
+		ref_pool = new Ref_Pool();
 	}
 	void tearDown()
 	{
+		delete ref_pool;
 		delete mml_input;
 		delete song;
 	}
 	void test_generator()
 	{
 		mml_input->read_line("A c1 r2 c2 @2 v12 ^4 &c8");
-		Track_Info info = Track_Info_Generator(*song, song->get_track(0));
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
 		auto& track_map = info.events;
 		auto it = track_map.begin();
 		CPPUNIT_ASSERT_EQUAL((int)0, it->first);
@@ -58,7 +75,7 @@ public:
 		mml_input->read_line("*31 @31c ;D30b");
 		mml_input->read_line("*32 @32c ;D30c");
 		mml_input->read_line("A l16 D30 ab8c4");
-		Track_Info info = Track_Info_Generator(*song, song->get_track(0));
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
 		auto& track_map = info.events;
 		auto it = track_map.begin();
 		CPPUNIT_ASSERT_EQUAL((int)0, it->first);
@@ -76,7 +93,290 @@ public:
 		it++;
 		CPPUNIT_ASSERT(it == track_map.end());
 	}
+	void test_reference_pool()
+	{
+		mml_input->read_line("*30 c4");
+		mml_input->read_line("A *30 *30");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		auto& track_map = info.events;
+		auto it = track_map.begin();
+		auto first = it->second.references;
+		it++;
+		auto second = it->second.references;
+		it++;
+		CPPUNIT_ASSERT(it == track_map.end());
+
+		// both calls play the same note, so the note reference is only stored once
+		unsigned int total = 0;
+		bool shared = false;
+		for(auto id : first)
+		{
+			CPPUNIT_ASSERT(id != Ref_Pool::invalid_id);
+			CPPUNIT_ASSERT(ref_pool->get(id) != nullptr);
+			for(auto id2 : second)
+				shared |= (id == id2);
+			total++;
+		}
+		for(auto id : second)
+		{
+			CPPUNIT_ASSERT(ref_pool->get(id) != nullptr);
+			total++;
+		}
+		CPPUNIT_ASSERT(shared);
+		CPPUNIT_ASSERT(ref_pool->size() < total);
+		CPPUNIT_ASSERT_EQUAL(first.begin()[0], ref_pool->find(ref_pool->get(first.begin()[0])));
+	}
+	void test_reference_pool_shared()
+	{
+		mml_input->read_line("*30 c4");
+		mml_input->read_line("A *30");
+		mml_input->read_line("B *30");
+		Track_Info info_a = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info info_b = Track_Info_Generator(*song, song->get_track(1), *ref_pool);
+		auto ref_a = info_a.events.get_references(0);
+		auto ref_b = info_b.events.get_references(0);
+
+		// each generator has its own ids, but the note in the subroutine is the same reference
+		Ref_Pool::Id id_a = Ref_Pool::invalid_id, id_b = Ref_Pool::invalid_id;
+		for(auto i : ref_a)
+			for(auto j : ref_b)
+			{
+				if(ref_pool->get(i) == ref_pool->get(j))
+				{
+					id_a = i;
+					id_b = j;
+				}
+			}
+		CPPUNIT_ASSERT(id_a != Ref_Pool::invalid_id);
+		CPPUNIT_ASSERT(id_a != id_b);
+
+		std::vector<Ref_Pool::Id> ids;
+		ref_pool->find(ref_pool->get(id_a), ids);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, ids.size());
+		CPPUNIT_ASSERT(std::count(ids.begin(), ids.end(), id_a));
+		CPPUNIT_ASSERT(std::count(ids.begin(), ids.end(), id_b));
+	}
+	void test_reference_pool_many()
+	{
+		// enough references to grow the hash table several times
+		const unsigned int count = 5000;
+		std::vector<std::shared_ptr<InputRef>> refs;
+		for(unsigned int i = 0; i < count; i++)
+			refs.push_back(std::make_shared<InputRef>("", "", i, 0));
+		auto& shard = ref_pool->add_shard();
+		std::vector<Ref_Pool::Id> ids;
+		shard.intern(refs, ids);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)count, ids.size());
+		CPPUNIT_ASSERT_EQUAL((std::size_t)count, ref_pool->size());
+
+		// ids are unique and stay the same after the table has grown
+		std::vector<Ref_Pool::Id> sorted_ids = ids;
+		std::sort(sorted_ids.begin(), sorted_ids.end());
+		CPPUNIT_ASSERT(std::adjacent_find(sorted_ids.begin(), sorted_ids.end()) == sorted_ids.end());
+		for(unsigned int i = 0; i < count; i++)
+		{
+			CPPUNIT_ASSERT_EQUAL(ids[i], shard.intern(refs[i]));
+			CPPUNIT_ASSERT_EQUAL(ids[i], ref_pool->find(refs[i].get()));
+			CPPUNIT_ASSERT_EQUAL(refs[i].get(), ref_pool->get(ids[i]));
+		}
+		CPPUNIT_ASSERT_EQUAL((std::size_t)count, ref_pool->size());
+
+		// null references are not added
+		CPPUNIT_ASSERT_EQUAL(Ref_Pool::invalid_id, shard.intern(nullptr));
+		shard.intern({nullptr, refs[0]}, ids);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)count + 1, ids.size());
+		CPPUNIT_ASSERT_EQUAL(ids[0], ids.back());
+		CPPUNIT_ASSERT_EQUAL((std::size_t)count, ref_pool->size());
+	}
+	void test_event_accessors()
+	{
+		mml_input->read_line("A @3 v10 k2 M1 G4 c4 & d8 ^8 r4 o5 V100 e4");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		auto& events = info.events;
+		CPPUNIT_ASSERT(events.size() > 0);
+		for(std::size_t i = 0; i < events.size(); i++)
+		{
+			auto event = events.get(i);
+			CPPUNIT_ASSERT_EQUAL(event.first, events.get_time(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.note, events.get_note(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.on_time, events.get_on_time(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.off_time, events.get_off_time(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.is_tie, events.is_tie(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.is_slur, events.is_slur(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.coarse_volume_flag, events.is_coarse_volume(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.volume, events.get_volume(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.instrument, events.get_instrument(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.transpose, events.get_transpose(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.pitch_envelope, events.get_pitch_envelope(i));
+			CPPUNIT_ASSERT_EQUAL(event.second.portamento, events.get_portamento(i));
+			CPPUNIT_ASSERT(event.second.references.begin() == events.get_references(i).begin());
+			CPPUNIT_ASSERT(event.second.references.end() == events.get_references(i).end());
+		}
+	}
+	void test_range()
+	{
+		mml_input->read_line("A c4 d4");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info::Span spans[4];
+
+		// event playing at the start is included
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, info.events_in_range(30, 200, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, spans[0].last);
+		CPPUNIT_ASSERT_EQUAL((int)0, spans[0].offset);
+
+		// end is exclusive
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, info.events_in_range(0, 24, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)0, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, spans[0].last);
+
+		// no loop, nothing after the end
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, info.events_in_range(48, 200, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, info.events_in_range(100, 200, spans, 4));
+
+		// empty range
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, info.events_in_range(10, 10, spans, 4));
+	}
+	void test_range_loop()
+	{
+		mml_input->read_line("A c4 d4 L e4 f4");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info::Span spans[4];
+
+		CPPUNIT_ASSERT_EQUAL((int)48, info.loop_start);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)48, info.loop_length);
+
+		// wrap back to the loop point at the end of the track
+		CPPUNIT_ASSERT_EQUAL((unsigned int)2, info.events_in_range(60, 130, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)4, spans[0].last);
+		CPPUNIT_ASSERT_EQUAL((int)0, spans[0].offset);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, spans[1].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)4, spans[1].last);
+		CPPUNIT_ASSERT_EQUAL((int)48, spans[1].offset);
+
+		// start inside a later loop repetition
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, info.events_in_range(200, 210, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)3, spans[0].last);
+		CPPUNIT_ASSERT_EQUAL((int)144, spans[0].offset);
+
+		// range ending exactly at the loop point does not wrap
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, info.events_in_range(80, 96, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)3, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)4, spans[0].last);
+	}
+	void test_range_zero_length_loop()
+	{
+		mml_input->read_line("A c4 d4 L");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info::Span spans[4];
+
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, info.loop_length);
+
+		// must not repeat the loop forever
+		CPPUNIT_ASSERT_EQUAL((unsigned int)1, info.events_in_range(30, 1000, spans, 4));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)2, spans[0].last);
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, info.events_in_range(48, 1000, spans, 4));
+	}
+	void test_range_max_spans()
+	{
+		mml_input->read_line("A c4 L d4");
+		Track_Info info = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info::Span spans[3];
+
+		CPPUNIT_ASSERT_EQUAL((unsigned int)3, info.events_in_range(0, 10000, spans, 3));
+		CPPUNIT_ASSERT_EQUAL((std::size_t)0, spans[0].first);
+		CPPUNIT_ASSERT_EQUAL((int)0, spans[0].offset);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, spans[1].first);
+		CPPUNIT_ASSERT_EQUAL((int)24, spans[1].offset);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)1, spans[2].first);
+		CPPUNIT_ASSERT_EQUAL((int)48, spans[2].offset);
+	}
+	void test_generate_passes()
+	{
+		mml_input->read_line("A c4 d4 e2 L f4 g4 a2");
+		Track_Info full = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+
+		Track_Info_Generator generator(*song, song->get_track(0), *ref_pool, 100);
+		CPPUNIT_ASSERT_EQUAL(false, generator.complete);
+		CPPUNIT_ASSERT_EQUAL((std::size_t)3, generator.events.size());
+		CPPUNIT_ASSERT_EQUAL((unsigned int)0, generator.loop_length);
+		CPPUNIT_ASSERT_EQUAL(false, generator.generate(200));
+		CPPUNIT_ASSERT_EQUAL(true, generator.generate(UINT_MAX));
+		CPPUNIT_ASSERT_EQUAL(true, generator.complete);
+
+		CPPUNIT_ASSERT_EQUAL(full.length, generator.length);
+		CPPUNIT_ASSERT_EQUAL(full.loop_start, generator.loop_start);
+		CPPUNIT_ASSERT_EQUAL(full.loop_length, generator.loop_length);
+		CPPUNIT_ASSERT_EQUAL(full.events.size(), generator.events.size());
+		for(std::size_t i = 0; i < full.events.size(); i++)
+		{
+			CPPUNIT_ASSERT_EQUAL(full.events.get_time(i), generator.events.get_time(i));
+			CPPUNIT_ASSERT_EQUAL(full.events.get(i).second.note, generator.events.get(i).second.note);
+		}
+	}
+	void test_compare()
+	{
+		Song song2;
+		MML_Input mml_input2(&song2);
+		mml_input->read_line("A c4 d4 e4 f4 g4");
+		mml_input2.read_line("A c4 d4 e8 r8 f4 g4");
+		Track_Info info1 = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info info2 = Track_Info_Generator(song2, song2.get_track(0), *ref_pool);
+
+		int start = -1, end = -1;
+		CPPUNIT_ASSERT_EQUAL(false, info1.compare(info1, start, end));
+		CPPUNIT_ASSERT_EQUAL(-1, start);
+
+		// only e4 changed
+		CPPUNIT_ASSERT_EQUAL(true, info1.compare(info2, start, end));
+		CPPUNIT_ASSERT_EQUAL(48, start);
+		CPPUNIT_ASSERT_EQUAL(72, end);
+		CPPUNIT_ASSERT_EQUAL(true, info2.compare(info1, start, end));
+		CPPUNIT_ASSERT_EQUAL(48, start);
+		CPPUNIT_ASSERT_EQUAL(72, end);
+	}
+	void test_compare_loop()
+	{
+		Song song2;
+		MML_Input mml_input2(&song2);
+		mml_input->read_line("A c4 d4 L e4 f4");
+		mml_input2.read_line("A c4 d4 e4 L f4");
+		Track_Info info1 = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info info2 = Track_Info_Generator(song2, song2.get_track(0), *ref_pool);
+
+		// same events, but the loop repetitions differ
+		int start = -1, end = -1;
+		CPPUNIT_ASSERT_EQUAL(true, info1.compare(info2, start, end));
+		CPPUNIT_ASSERT_EQUAL(96, start);
+		CPPUNIT_ASSERT_EQUAL(INT_MAX, end);
+
+		// incomplete track
+		Track_Info_Generator partial(*song, song->get_track(0), *ref_pool, 30);
+		CPPUNIT_ASSERT_EQUAL(true, info1.compare(partial, start, end));
+		CPPUNIT_ASSERT_EQUAL(48, start);
+		CPPUNIT_ASSERT_EQUAL(INT_MAX, end);
+	}
+	void test_compare_tempo()
+	{
+		Song song2;
+		MML_Input mml_input2(&song2);
+		mml_input->read_line("A t120 c4 d4 e4 f4");
+		mml_input2.read_line("A t120 c4 t150 d4 e4 f4");
+		Track_Info info1 = Track_Info_Generator(*song, song->get_track(0), *ref_pool);
+		Track_Info info2 = Track_Info_Generator(song2, song2.get_track(0), *ref_pool);
+
+		// same events, but the tempo changes at the second note
+		int start = -1, end = -1;
+		CPPUNIT_ASSERT_EQUAL(true, info1.compare(info2, start, end));
+		CPPUNIT_ASSERT_EQUAL(24, start);
+		CPPUNIT_ASSERT_EQUAL(INT_MAX, end);
+		CPPUNIT_ASSERT_EQUAL(true, info2.compare(info1, start, end));
+		CPPUNIT_ASSERT_EQUAL(24, start);
+		CPPUNIT_ASSERT_EQUAL(false, info2.compare(info2, start, end));
+	}
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(Track_Info_Test);
-
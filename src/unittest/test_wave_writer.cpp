@@ -0,0 +1,112 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../wave_writer.h"
+
+class Wave_Writer_Test : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(Wave_Writer_Test);
+	CPPUNIT_TEST(test_write);
+	CPPUNIT_TEST(test_formats);
+	CPPUNIT_TEST(test_open_fail);
+	CPPUNIT_TEST_SUITE_END();
+private:
+	const char* filename = "test_wave_writer.wav";
+
+	static uint32_t read32(const std::vector<uint8_t>& data, int offset)
+	{
+		return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | ((uint32_t)data[offset + 3] << 24);
+	}
+	static uint16_t read16(const std::vector<uint8_t>& data, int offset)
+	{
+		return data[offset] | (data[offset + 1] << 8);
+	}
+	std::vector<uint8_t> read_file()
+	{
+		std::ifstream file(filename, std::ios::binary);
+		return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	}
+public:
+	void setUp()
+	{
+	}
+	void tearDown()
+	{
+		std::remove(filename);
+	}
+	void test_write()
+	{
+		Wave_Writer writer;
+		CPPUNIT_ASSERT(writer.open(filename, 48000, 2));
+		const int16_t samples[] = {1, -1, 0x1234, -32768, 32767, 0};
+		CPPUNIT_ASSERT(writer.write(samples, 2));
+		CPPUNIT_ASSERT(writer.write(samples + 4, 1));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)3, writer.get_frame_count());
+		CPPUNIT_ASSERT(writer.close());
+
+		auto data = read_file();
+		CPPUNIT_ASSERT_EQUAL((std::size_t)44 + 12, data.size());
+		CPPUNIT_ASSERT_EQUAL(std::string("RIFF"), std::string(data.begin(), data.begin() + 4));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)(36 + 12), read32(data, 4));
+		CPPUNIT_ASSERT_EQUAL(std::string("WAVEfmt "), std::string(data.begin() + 8, data.begin() + 16));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)1, read16(data, 20));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)2, read16(data, 22));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)48000, read32(data, 24));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)48000 * 4, read32(data, 28));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)4, read16(data, 32));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)16, read16(data, 34));
+		CPPUNIT_ASSERT_EQUAL(std::string("data"), std::string(data.begin() + 36, data.begin() + 40));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)12, read32(data, 40));
+		for(int i = 0; i < 6; i++)
+			CPPUNIT_ASSERT_EQUAL(samples[i], (int16_t)read16(data, 44 + i * 2));
+	}
+	void test_formats()
+	{
+		const WAVE_32BS samples[2] = {{0x400000, -0x800000}, {0x123456, 0x7fffffff}};
+		Wave_Writer writer;
+
+		// 24-bit mono
+		CPPUNIT_ASSERT(writer.open(filename, 96000, 1, Sample_Converter::S24));
+		CPPUNIT_ASSERT(writer.write(samples, 2));
+		CPPUNIT_ASSERT(writer.close());
+		auto data = read_file();
+		CPPUNIT_ASSERT_EQUAL((std::size_t)44 + 6, data.size());
+		CPPUNIT_ASSERT_EQUAL((uint16_t)1, read16(data, 20));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)1, read16(data, 22));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)96000 * 3, read32(data, 28));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)3, read16(data, 32));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)24, read16(data, 34));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)6, read32(data, 40));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0xe00000, read32(data, 43) >> 8);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0x7fffff, read32(data, 46) >> 8);
+
+		// float stereo
+		CPPUNIT_ASSERT(writer.open(filename, 48000, 2, Sample_Converter::F32));
+		CPPUNIT_ASSERT(writer.write(samples, 2));
+		CPPUNIT_ASSERT(writer.close());
+		data = read_file();
+		CPPUNIT_ASSERT_EQUAL((std::size_t)58 + 16, data.size());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)(50 + 16), read32(data, 4));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)18, read32(data, 16));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)3, read16(data, 20));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)48000 * 8, read32(data, 28));
+		CPPUNIT_ASSERT_EQUAL((uint16_t)32, read16(data, 34));
+		CPPUNIT_ASSERT_EQUAL(std::string("fact"), std::string(data.begin() + 38, data.begin() + 42));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)2, read32(data, 46));
+		CPPUNIT_ASSERT_EQUAL(std::string("data"), std::string(data.begin() + 50, data.begin() + 54));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)16, read32(data, 54));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0x3f000000, read32(data, 58));	// 0.5
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0xbf800000, read32(data, 62));	// -1.0
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0x3f800000, read32(data, 70));	// 1.0
+	}
+	void test_open_fail()
+	{
+		Wave_Writer writer;
+		CPPUNIT_ASSERT(!writer.open("nonexistent_directory/test.wav", 44100, 2));
+		CPPUNIT_ASSERT(writer.close());
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Wave_Writer_Test);
@@ -0,0 +1,133 @@
+#include "wave_writer.h"
+
+#include <algorithm>
+
+Wave_Writer::Wave_Writer()
+	: file()
+	, sample_rate(0)
+	, converter()
+	, frame_count(0)
+	, buffer()
+{
+}
+
+Wave_Writer::~Wave_Writer()
+{
+	close();
+}
+
+//! Create a WAV file and write the header.
+/*!
+ *  \return false if the file could not be created.
+ */
+bool Wave_Writer::open(const std::string& filename, uint32_t sample_rate, uint16_t channels, Sample_Converter::Format format)
+{
+	close();
+	this->sample_rate = sample_rate;
+	converter = Sample_Converter(format, channels);
+	frame_count = 0;
+	file.open(filename, std::ios::binary);
+	if(!file)
+		return false;
+	write_header();
+	return file.good();
+}
+
+//! Write interleaved 16-bit samples.
+/*!
+ *  The file must have been opened with the S16 format.
+ *
+ *  \return false if the data could not be written.
+ */
+bool Wave_Writer::write(const int16_t* samples, uint32_t frames)
+{
+	// WAV data is little endian
+	unsigned int channels = converter.get_channels();
+	buffer.resize(frames * channels * 2);
+	for(uint32_t i = 0; i < frames * channels; i++)
+	{
+		buffer[i * 2] = samples[i];
+		buffer[i * 2 + 1] = samples[i] >> 8;
+	}
+	file.write((const char*)buffer.data(), buffer.size());
+	frame_count += frames;
+	return file.good();
+}
+
+//! Convert and write mixed stereo samples.
+/*!
+ *  \return false if the data could not be written.
+ */
+bool Wave_Writer::write(const WAVE_32BS* samples, uint32_t frames)
+{
+	buffer.resize(frames * converter.get_frame_size());
+	converter.convert(samples, buffer.data(), frames);
+
+	// The converter output is in native byte order, WAV data is little endian
+	const uint16_t byte_order = 1;
+	unsigned int size = Sample_Converter::get_sample_size(converter.get_format());
+	if(!*(const uint8_t*)&byte_order && size != 3)
+	{
+		for(std::size_t i = 0; i < buffer.size(); i += size)
+			std::reverse(&buffer[i], &buffer[i + size]);
+	}
+	file.write((const char*)buffer.data(), buffer.size());
+	frame_count += frames;
+	return file.good();
+}
+
+//! Update the chunk sizes and close the file.
+/*!
+ *  \return false if the file could not be written.
+ */
+bool Wave_Writer::close()
+{
+	if(!file.is_open())
+		return true;
+	file.seekp(0);
+	write_header();
+	bool ok = file.good();
+	file.close();
+	return ok;
+}
+
+void Wave_Writer::write_header()
+{
+	bool is_float = converter.get_format() == Sample_Converter::F32;
+	uint16_t sample_size = Sample_Converter::get_sample_size(converter.get_format());
+	uint16_t frame_size = converter.get_frame_size();
+	uint32_t data_size = frame_count * frame_size;
+	file.write("RIFF", 4);
+	write32((is_float ? 50 : 36) + data_size);
+	file.write("WAVE", 4);
+	file.write("fmt ", 4);
+	write32(is_float ? 18 : 16);
+	write16(is_float ? 3 : 1);			// IEEE float or PCM
+	write16(converter.get_channels());
+	write32(sample_rate);
+	write32(sample_rate * frame_size);	// bytes per second
+	write16(frame_size);				// bytes per frame
+	write16(sample_size * 8);			// bits per sample
+	if(is_float)
+	{
+		// non-PCM formats need an extension size and a fact chunk
+		write16(0);
+		file.write("fact", 4);
+		write32(4);
+		write32(frame_count);
+	}
+	file.write("data", 4);
+	write32(data_size);
+}
+
+void Wave_Writer::write16(uint16_t data)
+{
+	char bytes[2] = {(char)data, (char)(data >> 8)};
+	file.write(bytes, 2);
+}
+
+void Wave_Writer::write32(uint32_t data)
+{
+	char bytes[4] = {(char)data, (char)(data >> 8), (char)(data >> 16), (char)(data >> 24)};
+	file.write(bytes, 4);
+}
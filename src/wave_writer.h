@@ -0,0 +1,44 @@
+#ifndef WAVE_WRITER_H
+#define WAVE_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "sample_converter.h"
+
+//! Writes PCM or float WAV files.
+/*!
+ *  The header is written when the file is opened and the chunk sizes are
+ *  filled in by close(), so the length does not need to be known in
+ *  advance.
+ */
+class Wave_Writer
+{
+	public:
+		Wave_Writer();
+		virtual ~Wave_Writer();
+
+		bool open(const std::string& filename, uint32_t sample_rate, uint16_t channels,
+			Sample_Converter::Format format = Sample_Converter::S16);
+		bool write(const int16_t* samples, uint32_t frames);
+		bool write(const WAVE_32BS* samples, uint32_t frames);
+		bool close();
+
+		//! Get the number of sample frames written.
+		inline uint32_t get_frame_count() const { return frame_count; }
+
+	private:
+		void write_header();
+		void write16(uint16_t data);
+		void write32(uint32_t data);
+
+		std::ofstream file;
+		uint32_t sample_rate;
+		Sample_Converter converter;
+		uint32_t frame_count;
+		std::vector<uint8_t> buffer;	// reused for each write
+};
+
+#endif